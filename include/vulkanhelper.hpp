@@ -8,8 +8,22 @@
 #include <set>
 #include <unordered_map>
 #include <variant>
-
-// If you want to use spirv reflect for reflection on descriptor sets in pipeline creation,
+#include <memory>
+#include <array>
+#include <bit>
+#include <span>
+#include <mutex>
+#include <thread>
+#include <future>
+#include <atomic>
+#include <utility>
+#include <condition_variable>
+#include <deque>
+#include <string_view>
+#include <cstddef>
+
+// Reflection of descriptor sets, push constants and vertex inputs uses a builtin SPIR-V scanner.
+// If you want to cross check it against spirv reflect through vkh::reflectShaderSpirvReflect,
 // set the following define to your include path of spirv_reflect like the following:
 // #define VULKANHELPER_SPIRV_REFLECT_INCLUDE_PATH <spirv_reflect.h>
 
@@ -22,6 +36,9 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <system_error>
 #ifdef VULKANHELPER_USE_SPIRV_REFLECT
 #include VULKANHELPER_SPIRV_REFLECT_INCLUDE_PATH
 #endif
@@ -165,75 +182,298 @@ namespace vkh {
 	}
 #endif
 
+	inline std::size_t hashCombine(std::size_t seed, std::size_t value) {
+		return seed ^ (value + static_cast<std::size_t>(0x9e3779b97f4a7c15ull) + (seed << 6) + (seed >> 2));
+	}
+
+	// One element of the payload passed to the update templates of the DescriptorSetLayoutCache.
+	// The payload holds one element per descriptor, in the same order as the bindings the layout was created with.
+	// An array binding takes descriptorCount consecutive elements.
+	union DescriptorUpdatePayload {
+		VkDescriptorBufferInfo buffer;
+		VkDescriptorImageInfo image;
+	};
+
+	// Thread safe. Lookups of already cached layouts are wait free and do not allocate,
+	// only the creation of a new layout takes a lock.
 	class DescriptorSetLayoutCache {
 	public:
 		DescriptorSetLayoutCache(vk::Device device);
+		DescriptorSetLayoutCache(const DescriptorSetLayoutCache &) = delete;
+		DescriptorSetLayoutCache &operator=(const DescriptorSetLayoutCache &) = delete;
+
 		vk::DescriptorSetLayout getLayout(const std::vector<vk::DescriptorSetLayoutBinding> &bindings);
+		vk::DescriptorSetLayout getLayout(std::span<const vk::DescriptorSetLayoutBinding> bindings);
+		// Update template writing every descriptor of every binding from an array of DescriptorUpdatePayload.
+		// Created on first use and cached alongside the layout.
+		vk::DescriptorUpdateTemplate getUpdateTemplate(std::span<const vk::DescriptorSetLayoutBinding> bindings);
+		// number of layouts created by the cache
+		std::size_t size() const;
 
 	private:
 		struct DescriptorLayoutHash {
-			std::size_t operator()(const std::vector<vk::DescriptorSetLayoutBinding> &bindings) const;
+			std::size_t operator()(std::span<const vk::DescriptorSetLayoutBinding> bindings) const;
+		};
+		struct DescriptorLayoutEqual {
+			bool operator()(std::span<const vk::DescriptorSetLayoutBinding> a, std::span<const vk::DescriptorSetLayoutBinding> b) const;
+		};
+
+		struct Entry {
+			std::size_t hash;
+			// pImmutableSamplers of the bindings point into immutableSamplers, not to the arrays of the caller
+			std::vector<vk::DescriptorSetLayoutBinding> bindings;
+			std::vector<vk::Sampler> immutableSamplers;
+			vk::UniqueDescriptorSetLayout layout;
+			// only written while holding the write mutex, published through updateTemplate
+			vk::UniqueDescriptorUpdateTemplate updateTemplateOwner;
+			std::atomic<VkDescriptorUpdateTemplate> updateTemplate{VK_NULL_HANDLE};
 		};
+		// Open addressing hash table with a power of two capacity.
+		// Once published, slots only ever go from empty to filled, so readers can probe it without a lock.
+		struct Table {
+			explicit Table(std::size_t capacity) : slots(capacity) {}
+			std::vector<std::atomic<Entry *>> slots;
+		};
+
+		Entry &getEntry(std::span<const vk::DescriptorSetLayoutBinding> bindings);
+
+		static Entry *find(const Table &table, std::size_t hash, std::span<const vk::DescriptorSetLayoutBinding> bindings);
+		static void insert(Table &table, Entry *entry);
 
 		vk::Device device;
-		std::unordered_map<std::vector<vk::DescriptorSetLayoutBinding>, vk::UniqueDescriptorSetLayout, DescriptorLayoutHash> bindingsToLayout;
+		std::atomic<Table *> table;
+		mutable std::mutex writeMutex;
+		std::vector<std::unique_ptr<Entry>> entries;
+		// tables replaced by bigger ones are kept alive, as readers might still be probing them
+		std::vector<std::unique_ptr<Table>> tables;
 	};
 
 #if defined(VULKANHELPER_IMPLEMENTATION)
 	DescriptorSetLayoutCache::DescriptorSetLayoutCache(vk::Device device)
 		: device{device} {
+		tables.push_back(std::make_unique<Table>(64));
+		table.store(tables.back().get(), std::memory_order_release);
 	}
 
 	vk::DescriptorSetLayout DescriptorSetLayoutCache::getLayout(const std::vector<vk::DescriptorSetLayoutBinding> &bindings) {
-		auto iter = bindingsToLayout.find(bindings);
-		if (iter != bindingsToLayout.end()) {
-			return *iter->second;
+		return getLayout(std::span<const vk::DescriptorSetLayoutBinding>{bindings});
+	}
+	vk::DescriptorSetLayout DescriptorSetLayoutCache::getLayout(std::span<const vk::DescriptorSetLayoutBinding> bindings) {
+		return *getEntry(bindings).layout;
+	}
+	vk::DescriptorUpdateTemplate DescriptorSetLayoutCache::getUpdateTemplate(std::span<const vk::DescriptorSetLayoutBinding> bindings) {
+		Entry &entry = getEntry(bindings);
+		if (VkDescriptorUpdateTemplate updateTemplate = entry.updateTemplate.load(std::memory_order_acquire)) {
+			return updateTemplate;
+		}
+
+		std::lock_guard lock{writeMutex};
+		if (!entry.updateTemplateOwner) {
+			std::vector<vk::DescriptorUpdateTemplateEntry> templateEntries;
+			templateEntries.reserve(bindings.size());
+			std::size_t element = 0;
+			for (const auto &binding : bindings) {
+				if (binding.descriptorCount == 0) {
+					continue;
+				}
+				templateEntries.push_back(vk::DescriptorUpdateTemplateEntry{
+					.dstBinding = binding.binding,
+					.dstArrayElement = 0,
+					.descriptorCount = binding.descriptorCount,
+					.descriptorType = binding.descriptorType,
+					.offset = element * sizeof(DescriptorUpdatePayload),
+					.stride = sizeof(DescriptorUpdatePayload),
+				});
+				element += binding.descriptorCount;
+			}
+			entry.updateTemplateOwner = device.createDescriptorUpdateTemplateUnique(vk::DescriptorUpdateTemplateCreateInfo{
+				.descriptorUpdateEntryCount = static_cast<uint32_t>(templateEntries.size()),
+				.pDescriptorUpdateEntries = templateEntries.data(),
+				.templateType = vk::DescriptorUpdateTemplateType::eDescriptorSet,
+				.descriptorSetLayout = *entry.layout,
+			});
+			entry.updateTemplate.store(*entry.updateTemplateOwner, std::memory_order_release);
+		}
+		return *entry.updateTemplateOwner;
+	}
+	DescriptorSetLayoutCache::Entry &DescriptorSetLayoutCache::getEntry(std::span<const vk::DescriptorSetLayoutBinding> bindings) {
+		const std::size_t hash = DescriptorLayoutHash{}(bindings);
+		if (Entry *entry = find(*table.load(std::memory_order_acquire), hash, bindings)) {
+			return *entry;
+		}
+
+		std::lock_guard lock{writeMutex};
+		// another thread might have created the layout while we were waiting for the lock
+		Table *currentTable = table.load(std::memory_order_relaxed);
+		if (Entry *entry = find(*currentTable, hash, bindings)) {
+			return *entry;
+		}
+
+		auto entry = std::make_unique<Entry>();
+		entry->hash = hash;
+		entry->bindings.assign(bindings.begin(), bindings.end());
+		std::size_t samplerCount = 0;
+		for (const auto &binding : bindings) {
+			samplerCount += binding.pImmutableSamplers ? binding.descriptorCount : 0;
+		}
+		// reserved up front, so the pointers into it stay valid
+		entry->immutableSamplers.reserve(samplerCount);
+		for (auto &binding : entry->bindings) {
+			if (binding.pImmutableSamplers) {
+				const vk::Sampler *samplers = entry->immutableSamplers.data() + entry->immutableSamplers.size();
+				entry->immutableSamplers.insert(entry->immutableSamplers.end(), binding.pImmutableSamplers, binding.pImmutableSamplers + binding.descriptorCount);
+				binding.pImmutableSamplers = samplers;
+			}
+		}
+		auto allocateInfo = vk::DescriptorSetLayoutCreateInfo{
+			.bindingCount = static_cast<uint32_t>(entry->bindings.size()),
+			.pBindings = entry->bindings.data(),
+		};
+		entry->layout = device.createDescriptorSetLayoutUnique(allocateInfo);
+
+		// keeping the load factor at or below one half keeps the probe sequences short
+		if ((entries.size() + 1) * 2 > currentTable->slots.size()) {
+			auto grownTable = std::make_unique<Table>(currentTable->slots.size() * 2);
+			for (const auto &oldEntry : entries) {
+				insert(*grownTable, oldEntry.get());
+			}
+			insert(*grownTable, entry.get());
+			table.store(grownTable.get(), std::memory_order_release);
+			tables.push_back(std::move(grownTable));
 		} else {
-			auto allocateInfo = vk::DescriptorSetLayoutCreateInfo{
-				.bindingCount = static_cast<uint32_t>(bindings.size()),
-				.pBindings = bindings.data(),
-			};
-			return *(bindingsToLayout[bindings] = device.createDescriptorSetLayoutUnique(allocateInfo));
+			insert(*currentTable, entry.get());
+		}
+
+		Entry &result = *entry;
+		entries.push_back(std::move(entry));
+		return result;
+	}
+	std::size_t DescriptorSetLayoutCache::size() const {
+		std::lock_guard lock{writeMutex};
+		return entries.size();
+	}
+	DescriptorSetLayoutCache::Entry *DescriptorSetLayoutCache::find(const Table &table, std::size_t hash, std::span<const vk::DescriptorSetLayoutBinding> bindings) {
+		const std::size_t mask = table.slots.size() - 1;
+		for (std::size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+			Entry *entry = table.slots[slot].load(std::memory_order_acquire);
+			if (!entry) {
+				return nullptr;
+			}
+			if (entry->hash == hash && DescriptorLayoutEqual{}(entry->bindings, bindings)) {
+				return entry;
+			}
+		}
+	}
+	void DescriptorSetLayoutCache::insert(Table &table, Entry *entry) {
+		const std::size_t mask = table.slots.size() - 1;
+		std::size_t slot = entry->hash & mask;
+		while (table.slots[slot].load(std::memory_order_relaxed)) {
+			slot = (slot + 1) & mask;
 		}
+		table.slots[slot].store(entry, std::memory_order_release);
 	}
-	std::size_t DescriptorSetLayoutCache::DescriptorLayoutHash::operator()(const std::vector<vk::DescriptorSetLayoutBinding> &bindings) const {
-		size_t h{0};
+	std::size_t DescriptorSetLayoutCache::DescriptorLayoutHash::operator()(std::span<const vk::DescriptorSetLayoutBinding> bindings) const {
+		size_t h{bindings.size()};
 		for (const auto &binding : bindings) {
-			h ^= static_cast<size_t>(binding.descriptorType);
-			h ^= static_cast<size_t>(binding.descriptorType);
+			h = hashCombine(h, binding.binding);
+			h = hashCombine(h, static_cast<size_t>(binding.descriptorType));
+			h = hashCombine(h, binding.descriptorCount);
+			h = hashCombine(h, static_cast<size_t>(static_cast<VkShaderStageFlags>(binding.stageFlags)));
+			if (binding.pImmutableSamplers) {
+				for (uint32_t i = 0; i < binding.descriptorCount; i++) {
+					h = hashCombine(h, std::hash<vk::Sampler>{}(binding.pImmutableSamplers[i]));
+				}
+			}
 		}
 		return h;
 	}
+	bool DescriptorSetLayoutCache::DescriptorLayoutEqual::operator()(std::span<const vk::DescriptorSetLayoutBinding> a, std::span<const vk::DescriptorSetLayoutBinding> b) const {
+		// the immutable samplers are compared by content like they are hashed, the pointers differ between callers
+		return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const vk::DescriptorSetLayoutBinding &x, const vk::DescriptorSetLayoutBinding &y) {
+			if (x.binding != y.binding || x.descriptorType != y.descriptorType || x.descriptorCount != y.descriptorCount || x.stageFlags != y.stageFlags) {
+				return false;
+			}
+			if (!x.pImmutableSamplers || !y.pImmutableSamplers) {
+				return x.pImmutableSamplers == y.pImmutableSamplers;
+			}
+			return std::equal(x.pImmutableSamplers, x.pImmutableSamplers + x.descriptorCount, y.pImmutableSamplers);
+		});
+	}
 #endif
 
+	struct DescriptorPoolStatistics {
+		// exponential moving averages of what got allocated between two resets of the allocator
+		std::vector<vk::DescriptorPoolSize> averageDescriptorCounts;
+		uint32_t averageSetCount{0};
+		uint32_t resetCount{0};
+	};
+
 	class GeneralDescriptorSetAllocator {
 	public:
 		GeneralDescriptorSetAllocator() = default;
-		GeneralDescriptorSetAllocator(vk::Device device, std::vector<vk::DescriptorPoolSize> specificPoolSizes = {}, vk::DescriptorPoolCreateFlagBits poolCreateFlags = {}, uint32_t maxSetsPerPool = 500);
+		// With adaptivePoolSizing, the sizes of new pools follow the observed usage between two resets,
+		// the given pool sizes are only the starting point. Only allocations that pass their bindings are observed,
+		// so the pools are not adapted after a reset period that also allocated sets through the overloads without them.
+		GeneralDescriptorSetAllocator(vk::Device device, std::vector<vk::DescriptorPoolSize> specificPoolSizes = {}, vk::DescriptorPoolCreateFlagBits poolCreateFlags = {}, uint32_t maxSetsPerPool = 500, bool adaptivePoolSizing = false);
 		void reset();
 		vk::DescriptorSet allocate(vk::DescriptorSetLayout layout);
+		// knowing the bindings of the layout lets the allocator track the used descriptor counts
+		vk::DescriptorSet allocate(vk::DescriptorSetLayout layout, std::span<const vk::DescriptorSetLayoutBinding> bindings);
 		std::vector<vk::DescriptorSet> allocate(vk::DescriptorSetLayout layout, uint32_t count);
+		// allocates one set per layout with a single call, bindings are all bindings of all layouts and only used for tracking
+		void allocate(std::span<const vk::DescriptorSetLayout> layouts, std::span<vk::DescriptorSet> sets, std::span<const vk::DescriptorSetLayoutBinding> bindings = {});
+
+		DescriptorPoolStatistics getStatistics() const;
+		// pre seeds the pool sizes with statistics of a previous run
+		void seedStatistics(const DescriptorPoolStatistics &statistics);
+		// incremented by every reset, all sets allocated before belong to an older generation
+		uint64_t getResetGeneration() const { return resetGeneration; }
 
 		const vk::Device device;
 
 	protected:
 		GeneralDescriptorSetAllocator(vk::Device device, vk::DescriptorPoolCreateFlagBits poolFlags, uint32_t maxSetsPerPool);
 
+		bool allocateSets(const vk::DescriptorSetLayout *layouts, uint32_t count, vk::DescriptorSet *sets);
+		void allocateOrFail(const vk::DescriptorSetLayout *layouts, uint32_t count, vk::DescriptorSet *sets);
+		void trackDescriptors(std::span<const vk::DescriptorSetLayoutBinding> bindings);
+		void updateStatistics();
+		void adaptPoolSizes();
+
 		vk::UniqueDescriptorPool getUnusedPool();
 		vk::UniqueDescriptorPool createPool();
+		vk::UniqueDescriptorPool createPool(const std::vector<vk::DescriptorPoolSize> &poolSizes, uint32_t maxSets);
 
-		const vk::DescriptorPoolCreateFlagBits poolCreateFlags;
-		const uint32_t maxSetsPerPool;
+		const vk::DescriptorPoolCreateFlagBits poolCreateFlags{};
+		const uint32_t maxSetsPerPool{500};
+		const bool adaptivePoolSizing{false};
 
 		vk::UniqueDescriptorPool currentPool;
+		// sets allocated from currentPool, a pool without any set is not worth replacing when an allocation fails
+		uint32_t currentPoolSetCount{0};
+		// sizes for newly created pools
 		std::vector<vk::DescriptorPoolSize> descriptorPoolSizes;
+		uint32_t poolMaxSets{0};
+		// sizes given on construction, used as a fallback for sets that do not fit into an adapted pool
+		std::vector<vk::DescriptorPoolSize> initialPoolSizes;
 		std::vector<vk::UniqueDescriptorPool> usedPools;
 		std::vector<vk::UniqueDescriptorPool> unusedPools;
+
+		// usage since the last reset
+		uint32_t allocatedSetCount{0};
+		// sets allocated without their bindings, their descriptors are missing from allocatedDescriptorCounts
+		uint32_t untrackedSetCount{0};
+		std::vector<vk::DescriptorPoolSize> allocatedDescriptorCounts;
+		// moving averages of the usage
+		float averageSetCount{0.0f};
+		std::vector<std::pair<vk::DescriptorType, float>> averageDescriptorCounts;
+		uint32_t resetCount{0};
+		uint64_t resetGeneration{0};
 	};
 
 #if defined(VULKANHELPER_IMPLEMENTATION)
-	GeneralDescriptorSetAllocator::GeneralDescriptorSetAllocator(vk::Device device, std::vector<vk::DescriptorPoolSize> specificPoolSizes, vk::DescriptorPoolCreateFlagBits poolCreateFlags, uint32_t maxSetsPerPool)
-		: device{device}, maxSetsPerPool{maxSetsPerPool}, poolCreateFlags{poolCreateFlags} {
+	GeneralDescriptorSetAllocator::GeneralDescriptorSetAllocator(vk::Device device, std::vector<vk::DescriptorPoolSize> specificPoolSizes, vk::DescriptorPoolCreateFlagBits poolCreateFlags, uint32_t maxSetsPerPool, bool adaptivePoolSizing)
+		: device{device}, poolCreateFlags{poolCreateFlags}, maxSetsPerPool{maxSetsPerPool}, adaptivePoolSizing{adaptivePoolSizing}, poolMaxSets{maxSetsPerPool} {
 		this->descriptorPoolSizes.push_back(vk::DescriptorPoolSize{.type = vk::DescriptorType::eSampler, .descriptorCount = 500u});
 		this->descriptorPoolSizes.push_back(vk::DescriptorPoolSize{.type = vk::DescriptorType::eCombinedImageSampler, .descriptorCount = 4000u});
 		this->descriptorPoolSizes.push_back(vk::DescriptorPoolSize{.type = vk::DescriptorType::eSampledImage, .descriptorCount = 4000u});
@@ -241,8 +481,6 @@ namespace vkh {
 		this->descriptorPoolSizes.push_back(vk::DescriptorPoolSize{.type = vk::DescriptorType::eStorageTexelBuffer, .descriptorCount = 1000u});
 		this->descriptorPoolSizes.push_back(vk::DescriptorPoolSize{.type = vk::DescriptorType::eUniformBuffer, .descriptorCount = 1000u});
 		this->descriptorPoolSizes.push_back(vk::DescriptorPoolSize{.type = vk::DescriptorType::eStorageBuffer, .descriptorCount = 1000u});
-		this->descriptorPoolSizes.push_back(vk::DescriptorPoolSize{.type = vk::DescriptorType::eUniformBuffer, .descriptorCount = 1000u});
-		this->descriptorPoolSizes.push_back(vk::DescriptorPoolSize{.type = vk::DescriptorType::eStorageBuffer, .descriptorCount = 1000u});
 		this->descriptorPoolSizes.push_back(vk::DescriptorPoolSize{.type = vk::DescriptorType::eUniformBufferDynamic, .descriptorCount = 1000u});
 		this->descriptorPoolSizes.push_back(vk::DescriptorPoolSize{.type = vk::DescriptorType::eStorageBufferDynamic, .descriptorCount = 1000u});
 		this->descriptorPoolSizes.push_back(vk::DescriptorPoolSize{.type = vk::DescriptorType::eInputAttachment, .descriptorCount = 500u});
@@ -261,17 +499,17 @@ namespace vkh {
 				this->descriptorPoolSizes.push_back(specificPoolSize);
 			}
 		}
+		initialPoolSizes = descriptorPoolSizes;
 
 		currentPool = createPool();
 	}
 	GeneralDescriptorSetAllocator::GeneralDescriptorSetAllocator(vk::Device device, vk::DescriptorPoolCreateFlagBits poolFlags, uint32_t maxSetsPerPool)
-		: device{device}, poolCreateFlags{poolFlags}, maxSetsPerPool{maxSetsPerPool} {
+		: device{device}, poolCreateFlags{poolFlags}, maxSetsPerPool{maxSetsPerPool}, poolMaxSets{maxSetsPerPool} {
 	}
 	void GeneralDescriptorSetAllocator::reset() {
 		if (currentPool) {
 			device.resetDescriptorPool(*currentPool);
 			unusedPools.push_back(std::move(currentPool));
-			currentPool.release();
 		}
 
 		for (auto &&pool : usedPools) {
@@ -279,41 +517,191 @@ namespace vkh {
 			unusedPools.push_back(std::move(pool));
 		}
 		usedPools.clear();
+
+		// with untracked sets the counts are incomplete, adapting to them could drop types that are still in use
+		const bool tracked = untrackedSetCount == 0;
+		updateStatistics();
+		if (adaptivePoolSizing && tracked) {
+			adaptPoolSizes();
+		}
+
+		currentPool = getUnusedPool();
+		currentPoolSetCount = 0;
+		resetGeneration++;
 	}
 	vk::DescriptorSet GeneralDescriptorSetAllocator::allocate(vk::DescriptorSetLayout layout) {
-		auto result = device.allocateDescriptorSets({.descriptorPool = *currentPool, .descriptorSetCount = 1, .pSetLayouts = &layout});
-		if (result.size() == 0) /* we need to reallocate with another pool */ {
+		untrackedSetCount++;
+		vk::DescriptorSet set;
+		allocateOrFail(&layout, 1, &set);
+		return set;
+	}
+	vk::DescriptorSet GeneralDescriptorSetAllocator::allocate(vk::DescriptorSetLayout layout, std::span<const vk::DescriptorSetLayoutBinding> bindings) {
+		trackDescriptors(bindings);
+		vk::DescriptorSet set;
+		allocateOrFail(&layout, 1, &set);
+		return set;
+	}
+	std::vector<vk::DescriptorSet> GeneralDescriptorSetAllocator::allocate(vk::DescriptorSetLayout layout, uint32_t count) {
+		untrackedSetCount += count;
+		std::vector<vk::DescriptorSetLayout> layouts(count, layout);
+		std::vector<vk::DescriptorSet> result(count);
+		allocateOrFail(layouts.data(), count, result.data());
+		return result;
+	}
+	void GeneralDescriptorSetAllocator::allocate(std::span<const vk::DescriptorSetLayout> layouts, std::span<vk::DescriptorSet> sets, std::span<const vk::DescriptorSetLayoutBinding> bindings) {
+		assert(sets.size() >= layouts.size());
+		if (bindings.empty()) {
+			untrackedSetCount += static_cast<uint32_t>(layouts.size());
+		}
+		trackDescriptors(bindings);
+		allocateOrFail(layouts.data(), static_cast<uint32_t>(layouts.size()), sets.data());
+	}
+	DescriptorPoolStatistics GeneralDescriptorSetAllocator::getStatistics() const {
+		DescriptorPoolStatistics statistics{
+			.averageSetCount = static_cast<uint32_t>(std::ceil(averageSetCount)),
+			.resetCount = resetCount,
+		};
+		for (auto [type, average] : averageDescriptorCounts) {
+			statistics.averageDescriptorCounts.push_back(vk::DescriptorPoolSize{.type = type, .descriptorCount = static_cast<uint32_t>(std::ceil(average))});
+		}
+		return statistics;
+	}
+	void GeneralDescriptorSetAllocator::seedStatistics(const DescriptorPoolStatistics &statistics) {
+		averageSetCount = static_cast<float>(statistics.averageSetCount);
+		averageDescriptorCounts.clear();
+		for (auto &poolSize : statistics.averageDescriptorCounts) {
+			averageDescriptorCounts.emplace_back(poolSize.type, static_cast<float>(poolSize.descriptorCount));
+		}
+		// makes the next reset blend into the seeded averages instead of replacing them
+		resetCount = std::max(resetCount, 1u);
+		if (adaptivePoolSizing) {
+			adaptPoolSizes();
+		}
+	}
+	bool GeneralDescriptorSetAllocator::allocateSets(const vk::DescriptorSetLayout *layouts, uint32_t count, vk::DescriptorSet *sets) {
+		auto tryAllocate = [&](vk::DescriptorPool pool) {
+			vk::DescriptorSetAllocateInfo allocateInfo{
+				.descriptorPool = pool,
+				.descriptorSetCount = count,
+				.pSetLayouts = layouts,
+			};
+			auto result = device.allocateDescriptorSets(&allocateInfo, sets);
+			if (result == vk::Result::eErrorOutOfPoolMemory || result == vk::Result::eErrorFragmentedPool) {
+				return false;
+			}
+			if (result != vk::Result::eSuccess) {
+				throw std::runtime_error("error: failed to allocate descriptor sets: " + vk::to_string(result));
+			}
+			allocatedSetCount += count;
+			currentPoolSetCount += count;
+			return true;
+		};
+
+		if (tryAllocate(*currentPool)) {
+			return true;
+		}
+
+		if (currentPoolSetCount > 0) {
+			// the current pool is full, so we need to allocate from another one
 			usedPools.push_back(std::move(currentPool));
 			currentPool = getUnusedPool();
+			currentPoolSetCount = 0;
+			if (tryAllocate(*currentPool)) {
+				return true;
+			}
+		}
 
-			result = device.allocateDescriptorSets({.descriptorPool = *currentPool, .descriptorSetCount = 1, .pSetLayouts = &layout});
+		// not even an empty pool can hold all the sets, so split them across pools
+		if (count > 1) {
+			const uint32_t half = count / 2;
+			return allocateSets(layouts, half, sets) && allocateSets(layouts + half, count - half, sets + half);
+		}
 
-			if (result.size() == 0) {
-				// possible cause for this error is that the requested descriptor count exceeds the maximum descriptor pool size
-				std::cerr << "error: discriptor allocator can not allocate this descriptor set layout!\n";
-				assert(false);
+		// the set might need more descriptors than a whole adapted pool has, so fall back to the initial sizes
+		usedPools.push_back(std::move(currentPool));
+		currentPool = createPool(initialPoolSizes.empty() ? descriptorPoolSizes : initialPoolSizes, maxSetsPerPool);
+		currentPoolSetCount = 0;
+		return tryAllocate(*currentPool);
+	}
+	void GeneralDescriptorSetAllocator::allocateOrFail(const vk::DescriptorSetLayout *layouts, uint32_t count, vk::DescriptorSet *sets) {
+		if (!allocateSets(layouts, count, sets)) {
+			// possible cause for this error is that the requested descriptor count exceeds the maximum descriptor pool size
+			throw std::runtime_error("error: descriptor allocator can not allocate this descriptor set layout");
+		}
+	}
+	void GeneralDescriptorSetAllocator::trackDescriptors(std::span<const vk::DescriptorSetLayoutBinding> bindings) {
+		for (const auto &binding : bindings) {
+			auto iter = std::find_if(allocatedDescriptorCounts.begin(), allocatedDescriptorCounts.end(), [&](const vk::DescriptorPoolSize &poolSize) {
+				return poolSize.type == binding.descriptorType;
+			});
+			if (iter != allocatedDescriptorCounts.end()) {
+				iter->descriptorCount += binding.descriptorCount;
+			} else {
+				allocatedDescriptorCounts.push_back(vk::DescriptorPoolSize{.type = binding.descriptorType, .descriptorCount = binding.descriptorCount});
 			}
 		}
-
-		return std::move(result.front());
 	}
-	std::vector<vk::DescriptorSet> GeneralDescriptorSetAllocator::allocate(vk::DescriptorSetLayout layout, uint32_t count) {
-		std::vector<vk::DescriptorSetLayout> layouts(count, layout);
-		auto result = device.allocateDescriptorSets({.descriptorPool = *currentPool, .descriptorSetCount = count, .pSetLayouts = layouts.data()});
-		if (result.size() == 0) /* we need to reallocate with another pool */ {
-			usedPools.push_back(std::move(currentPool));
-			currentPool = getUnusedPool();
+	void GeneralDescriptorSetAllocator::updateStatistics() {
+		constexpr float SMOOTHING = 0.25f;
+		auto blend = [&](float average, float observed) {
+			return resetCount == 0 ? observed : average + SMOOTHING * (observed - average);
+		};
 
-			result = device.allocateDescriptorSets({.descriptorPool = *currentPool, .descriptorSetCount = count, .pSetLayouts = layouts.data()});
+		averageSetCount = blend(averageSetCount, static_cast<float>(allocatedSetCount));
+		for (auto &[type, average] : averageDescriptorCounts) {
+			auto iter = std::find_if(allocatedDescriptorCounts.begin(), allocatedDescriptorCounts.end(), [&](const vk::DescriptorPoolSize &poolSize) {
+				return poolSize.type == type;
+			});
+			average = blend(average, iter != allocatedDescriptorCounts.end() ? static_cast<float>(iter->descriptorCount) : 0.0f);
+		}
+		for (auto &allocated : allocatedDescriptorCounts) {
+			auto iter = std::find_if(averageDescriptorCounts.begin(), averageDescriptorCounts.end(), [&](const auto &average) {
+				return average.first == allocated.type;
+			});
+			if (iter == averageDescriptorCounts.end()) {
+				averageDescriptorCounts.emplace_back(allocated.type, blend(0.0f, static_cast<float>(allocated.descriptorCount)));
+			}
+		}
 
-			if (result.size() == 0) {
-				// possible cause for this error is that the requested descriptor count exceeds the maximum descriptor pool size
-				std::cerr << "error: discriptor allocator can not allocate this descriptor set layout!\n";
-				assert(false);
+		resetCount += 1;
+		allocatedSetCount = 0;
+		untrackedSetCount = 0;
+		allocatedDescriptorCounts.clear();
+	}
+	void GeneralDescriptorSetAllocator::adaptPoolSizes() {
+		constexpr float HEADROOM = 1.25f;
+		constexpr uint32_t MIN_COUNT = 16;
+
+		std::vector<vk::DescriptorPoolSize> newPoolSizes;
+		for (auto [type, average] : averageDescriptorCounts) {
+			if (average > 0.0f) {
+				newPoolSizes.push_back(vk::DescriptorPoolSize{.type = type, .descriptorCount = std::max(MIN_COUNT, static_cast<uint32_t>(std::ceil(average * HEADROOM)))});
 			}
 		}
+		// without any tracked descriptors there is nothing to size the pools after
+		if (newPoolSizes.empty()) {
+			return;
+		}
+		uint32_t newMaxSets = std::max(MIN_COUNT, static_cast<uint32_t>(std::ceil(averageSetCount * HEADROOM)));
+
+		// recreating the pools is only worth it, when the sizes changed by more than a quarter
+		auto differs = [](uint64_t a, uint64_t b) {
+			return a * 4 < b * 3 || b * 4 < a * 3;
+		};
+		bool changed = newPoolSizes.size() != descriptorPoolSizes.size() || differs(newMaxSets, poolMaxSets);
+		for (auto &newPoolSize : newPoolSizes) {
+			auto iter = std::find_if(descriptorPoolSizes.begin(), descriptorPoolSizes.end(), [&](const vk::DescriptorPoolSize &poolSize) {
+				return poolSize.type == newPoolSize.type;
+			});
+			changed |= iter == descriptorPoolSizes.end() || differs(iter->descriptorCount, newPoolSize.descriptorCount);
+		}
 
-		return std::move(result);
+		if (changed) {
+			descriptorPoolSizes = std::move(newPoolSizes);
+			poolMaxSets = newMaxSets;
+			// unused pools are all reset, so they can be replaced by pools with the new sizes
+			unusedPools.clear();
+		}
 	}
 	vk::UniqueDescriptorPool GeneralDescriptorSetAllocator::getUnusedPool() {
 		if (unusedPools.empty()) {
@@ -325,11 +713,14 @@ namespace vkh {
 		}
 	}
 	vk::UniqueDescriptorPool GeneralDescriptorSetAllocator::createPool() {
+		return createPool(descriptorPoolSizes, poolMaxSets);
+	}
+	vk::UniqueDescriptorPool GeneralDescriptorSetAllocator::createPool(const std::vector<vk::DescriptorPoolSize> &poolSizes, uint32_t maxSets) {
 		auto allocInfo = vk::DescriptorPoolCreateInfo{
 			.flags = poolCreateFlags,
-			.maxSets = maxSetsPerPool,
-			.poolSizeCount = static_cast<uint32_t>(descriptorPoolSizes.size()),
-			.pPoolSizes = descriptorPoolSizes.data(),
+			.maxSets = maxSets,
+			.poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
+			.pPoolSizes = poolSizes.data(),
 		};
 
 		return device.createDescriptorPoolUnique(allocInfo);
@@ -357,31 +748,94 @@ namespace vkh {
 			this->descriptorPoolSizes[i].type = bindings[i].descriptorType;
 			this->descriptorPoolSizes[i].descriptorCount = bindings[i].descriptorCount * maxSetsPerPool;
 		}
+		initialPoolSizes = descriptorPoolSizes;
 
 		currentPool = createPool();
 	}
 	vk::DescriptorSet DescriptorSetAllocator::allocate() {
-		auto result = device.allocateDescriptorSets({.descriptorPool = *currentPool, .descriptorSetCount = 1, .pSetLayouts = &layout});
-		if (result.size() == 0) /* we need to reallocate with another pool */ {
-			usedPools.push_back(std::move(currentPool));
-			currentPool = getUnusedPool();
-
-			result = device.allocateDescriptorSets({.descriptorPool = *currentPool, .descriptorSetCount = 1, .pSetLayouts = &layout});
-		}
-
-		return std::move(result.front());
+		return GeneralDescriptorSetAllocator::allocate(layout);
 	}
 	std::vector<vk::DescriptorSet> DescriptorSetAllocator::allocate(uint32_t count) {
-		std::vector<vk::DescriptorSetLayout> layouts(count, layout);
-		auto result = device.allocateDescriptorSets({.descriptorPool = *currentPool, .descriptorSetCount = count, .pSetLayouts = layouts.data()});
-		if (result.size() == 0) /* we need to reallocate with another pool */ {
-			usedPools.push_back(std::move(currentPool));
-			currentPool = getUnusedPool();
+		return GeneralDescriptorSetAllocator::allocate(layout, count);
+	}
+#endif
 
-			result = device.allocateDescriptorSets({.descriptorPool = *currentPool, .descriptorSetCount = count, .pSetLayouts = layouts.data()});
-		}
+	// Keeps one descriptor pool chain per recording thread and frame in flight.
+	// Threads only ever touch their own pools, so allocating needs no locks,
+	// and every thread resets its pools of a frame on its first allocation in that frame.
+	class FrameDescriptorAllocator {
+	public:
+		FrameDescriptorAllocator(vk::Device device, std::uint32_t threadCount, std::uint32_t framesInFlight, std::vector<vk::DescriptorPoolSize> specificPoolSizes = {}, uint32_t maxSetsPerPool = 500);
+
+		// Has to be called before the threads start allocating for the frame.
+		// The sets of a frame can only be recycled once the gpu is done with them, so if the
+		// fence of the frame is given, this waits for it to be signaled.
+		void beginFrame(std::uint32_t frameIndex, vk::Fence frameFence = {});
+		vk::DescriptorSet allocate(std::uint32_t threadIndex, vk::DescriptorSetLayout layout);
+		vk::DescriptorSet allocate(std::uint32_t threadIndex, vk::DescriptorSetLayout layout, std::span<const vk::DescriptorSetLayoutBinding> bindings);
+		// incremented whenever the pools of the thread in the frame get reset, must not race with that thread allocating
+		uint64_t getResetGeneration(std::uint32_t threadIndex, std::uint32_t frameIndex) const;
+
+		const vk::Device device;
+
+	private:
+		GeneralDescriptorSetAllocator &currentAllocator(std::uint32_t threadIndex);
 
-		return std::move(result);
+		struct alignas(64) Slot {
+			Slot(vk::Device device, const std::vector<vk::DescriptorPoolSize> &specificPoolSizes, uint32_t maxSetsPerPool);
+			GeneralDescriptorSetAllocator allocator;
+			// number of the last frame that reset this slot
+			std::uint64_t frameNumber{0};
+		};
+
+		const std::uint32_t threadCount;
+		const std::uint32_t framesInFlight;
+		std::atomic<std::uint32_t> frameIndex{0};
+		std::atomic<std::uint64_t> frameNumber{0};
+		// indexed with frameIndex * threadCount + threadIndex
+		std::vector<std::unique_ptr<Slot>> slots;
+	};
+
+#if defined(VULKANHELPER_IMPLEMENTATION)
+	FrameDescriptorAllocator::Slot::Slot(vk::Device device, const std::vector<vk::DescriptorPoolSize> &specificPoolSizes, uint32_t maxSetsPerPool)
+		: allocator{device, specificPoolSizes, {}, maxSetsPerPool} {
+	}
+	FrameDescriptorAllocator::FrameDescriptorAllocator(vk::Device device, std::uint32_t threadCount, std::uint32_t framesInFlight, std::vector<vk::DescriptorPoolSize> specificPoolSizes, uint32_t maxSetsPerPool)
+		: device{device}, threadCount{threadCount}, framesInFlight{framesInFlight} {
+		slots.reserve(threadCount * framesInFlight);
+		for (std::uint32_t i = 0; i < threadCount * framesInFlight; ++i) {
+			slots.push_back(std::make_unique<Slot>(device, specificPoolSizes, maxSetsPerPool));
+		}
+	}
+	void FrameDescriptorAllocator::beginFrame(std::uint32_t frameIndex, vk::Fence frameFence) {
+		assert(frameIndex < framesInFlight);
+		if (frameFence) {
+			while (device.waitForFences(frameFence, VK_TRUE, UINT64_MAX) == vk::Result::eTimeout) {
+			}
+		}
+		this->frameIndex.store(frameIndex, std::memory_order_relaxed);
+		this->frameNumber.fetch_add(1, std::memory_order_release);
+	}
+	vk::DescriptorSet FrameDescriptorAllocator::allocate(std::uint32_t threadIndex, vk::DescriptorSetLayout layout) {
+		return currentAllocator(threadIndex).allocate(layout);
+	}
+	vk::DescriptorSet FrameDescriptorAllocator::allocate(std::uint32_t threadIndex, vk::DescriptorSetLayout layout, std::span<const vk::DescriptorSetLayoutBinding> bindings) {
+		return currentAllocator(threadIndex).allocate(layout, bindings);
+	}
+	uint64_t FrameDescriptorAllocator::getResetGeneration(std::uint32_t threadIndex, std::uint32_t frameIndex) const {
+		assert(threadIndex < threadCount && frameIndex < framesInFlight);
+		return slots[frameIndex * threadCount + threadIndex]->allocator.getResetGeneration();
+	}
+	GeneralDescriptorSetAllocator &FrameDescriptorAllocator::currentAllocator(std::uint32_t threadIndex) {
+		assert(threadIndex < threadCount);
+		const std::uint64_t currentFrameNumber = frameNumber.load(std::memory_order_acquire);
+		Slot &slot = *slots[frameIndex.load(std::memory_order_relaxed) * threadCount + threadIndex];
+		if (slot.frameNumber != currentFrameNumber) {
+			// first allocation of this thread in the frame, the sets from the last use of the slot are retired
+			slot.allocator.reset();
+			slot.frameNumber = currentFrameNumber;
+		}
+		return slot.allocator;
 	}
 #endif
 
@@ -393,6 +847,158 @@ namespace vkh {
 	}
 #endif
 
+	// Returns an already written descriptor set when the layout and all buffer/image infos match one allocated before.
+	// Sets returned from the cache are shared, so they must not be updated afterwards.
+	// The cache is cleared whenever the allocator it is bound to got reset.
+	class DescriptorSetCache {
+	public:
+		DescriptorSetCache(const GeneralDescriptorSetAllocator *alloc);
+
+		// The payload is laid out like for DescriptorSetLayoutCache::getUpdateTemplate.
+		// Only the member of the union that the descriptor type uses is part of the key.
+		std::optional<vk::DescriptorSet> find(vk::DescriptorSetLayout layout, std::span<const vk::DescriptorSetLayoutBinding> bindings, std::span<const DescriptorUpdatePayload> payload);
+		void insert(vk::DescriptorSetLayout layout, std::span<const vk::DescriptorSetLayoutBinding> bindings, std::span<const DescriptorUpdatePayload> payload, vk::DescriptorSet set);
+		void clear();
+
+		uint64_t getHitCount() const { return hitCount; }
+		uint64_t getMissCount() const { return missCount; }
+		float getHitRate() const;
+		void resetCounters();
+
+	private:
+		struct KeyView {
+			vk::DescriptorSetLayout layout;
+			std::span<const vk::DescriptorSetLayoutBinding> bindings;
+			std::span<const DescriptorUpdatePayload> payload;
+		};
+		struct Key {
+			vk::DescriptorSetLayout layout;
+			std::vector<vk::DescriptorSetLayoutBinding> bindings;
+			std::vector<DescriptorUpdatePayload> payload;
+
+			operator KeyView() const { return KeyView{layout, bindings, payload}; }
+		};
+		struct KeyHash {
+			using is_transparent = void;
+			std::size_t operator()(const KeyView &key) const;
+			std::size_t operator()(const Key &key) const { return (*this)(static_cast<KeyView>(key)); }
+		};
+		struct KeyEqual {
+			using is_transparent = void;
+			bool operator()(const KeyView &a, const KeyView &b) const;
+		};
+
+		static bool usesImageInfo(vk::DescriptorType type);
+
+		void invalidateIfReset();
+
+		const GeneralDescriptorSetAllocator *alloc;
+		uint64_t generation;
+		std::unordered_map<Key, vk::DescriptorSet, KeyHash, KeyEqual> sets;
+		uint64_t hitCount{0};
+		uint64_t missCount{0};
+	};
+
+#if defined(VULKANHELPER_IMPLEMENTATION)
+	DescriptorSetCache::DescriptorSetCache(const GeneralDescriptorSetAllocator *alloc)
+		: alloc{alloc}, generation{alloc->getResetGeneration()} {
+	}
+	std::optional<vk::DescriptorSet> DescriptorSetCache::find(vk::DescriptorSetLayout layout, std::span<const vk::DescriptorSetLayoutBinding> bindings, std::span<const DescriptorUpdatePayload> payload) {
+		invalidateIfReset();
+		auto iter = sets.find(KeyView{layout, bindings, payload});
+		if (iter == sets.end()) {
+			missCount++;
+			return std::nullopt;
+		}
+		hitCount++;
+		return iter->second;
+	}
+	void DescriptorSetCache::insert(vk::DescriptorSetLayout layout, std::span<const vk::DescriptorSetLayoutBinding> bindings, std::span<const DescriptorUpdatePayload> payload, vk::DescriptorSet set) {
+		invalidateIfReset();
+		sets.insert_or_assign(Key{
+								  .layout = layout,
+								  .bindings = std::vector<vk::DescriptorSetLayoutBinding>(bindings.begin(), bindings.end()),
+								  .payload = std::vector<DescriptorUpdatePayload>(payload.begin(), payload.end()),
+							  },
+							  set);
+	}
+	void DescriptorSetCache::clear() {
+		sets.clear();
+	}
+	float DescriptorSetCache::getHitRate() const {
+		const uint64_t lookups = hitCount + missCount;
+		return lookups == 0 ? 0.0f : static_cast<float>(hitCount) / static_cast<float>(lookups);
+	}
+	void DescriptorSetCache::resetCounters() {
+		hitCount = 0;
+		missCount = 0;
+	}
+	void DescriptorSetCache::invalidateIfReset() {
+		if (generation != alloc->getResetGeneration()) {
+			// the pools of the cached sets got reset, so none of them is valid anymore
+			sets.clear();
+			generation = alloc->getResetGeneration();
+		}
+	}
+	bool DescriptorSetCache::usesImageInfo(vk::DescriptorType type) {
+		switch (type) {
+		case vk::DescriptorType::eSampler:
+		case vk::DescriptorType::eCombinedImageSampler:
+		case vk::DescriptorType::eSampledImage:
+		case vk::DescriptorType::eStorageImage:
+		case vk::DescriptorType::eInputAttachment:
+			return true;
+		default:
+			return false;
+		}
+	}
+	std::size_t DescriptorSetCache::KeyHash::operator()(const KeyView &key) const {
+		std::size_t h = std::hash<vk::DescriptorSetLayout>{}(key.layout);
+		std::size_t element = 0;
+		for (const auto &binding : key.bindings) {
+			h = hashCombine(h, binding.binding);
+			h = hashCombine(h, static_cast<size_t>(binding.descriptorType));
+			// padding and the bytes of the other union member are never read, they might hold anything
+			const bool image = usesImageInfo(binding.descriptorType);
+			for (uint32_t i = 0; i < binding.descriptorCount && element < key.payload.size(); i++, element++) {
+				const DescriptorUpdatePayload &payload = key.payload[element];
+				if (image) {
+					h = hashCombine(h, std::hash<vk::Sampler>{}(vk::Sampler{payload.image.sampler}));
+					h = hashCombine(h, std::hash<vk::ImageView>{}(vk::ImageView{payload.image.imageView}));
+					h = hashCombine(h, static_cast<size_t>(payload.image.imageLayout));
+				} else {
+					h = hashCombine(h, std::hash<vk::Buffer>{}(vk::Buffer{payload.buffer.buffer}));
+					h = hashCombine(h, static_cast<size_t>(payload.buffer.offset));
+					h = hashCombine(h, static_cast<size_t>(payload.buffer.range));
+				}
+			}
+		}
+		return h;
+	}
+	bool DescriptorSetCache::KeyEqual::operator()(const KeyView &a, const KeyView &b) const {
+		if (a.layout != b.layout || a.payload.size() != b.payload.size() ||
+			!std::equal(a.bindings.begin(), a.bindings.end(), b.bindings.begin(), b.bindings.end())) {
+			return false;
+		}
+		std::size_t element = 0;
+		for (const auto &binding : a.bindings) {
+			const bool image = usesImageInfo(binding.descriptorType);
+			for (uint32_t i = 0; i < binding.descriptorCount && element < a.payload.size(); i++, element++) {
+				const DescriptorUpdatePayload &x = a.payload[element];
+				const DescriptorUpdatePayload &y = b.payload[element];
+				const bool equal = image ? x.image.sampler == y.image.sampler && x.image.imageView == y.image.imageView && x.image.imageLayout == y.image.imageLayout
+										 : x.buffer.buffer == y.buffer.buffer && x.buffer.offset == y.buffer.offset && x.buffer.range == y.buffer.range;
+				if (!equal) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+#endif
+
+	class DescriptorSetBatch;
+
 	class DescriptorSetBuilder {
 	public:
 		DescriptorSetBuilder(GeneralDescriptorSetAllocator *alloc, DescriptorSetLayoutCache *layoutCache);
@@ -400,15 +1006,30 @@ namespace vkh {
 
 		DescriptorSetBuilder &addBufferBinding(const vk::DescriptorSetLayoutBinding &binding, const vk::DescriptorBufferInfo &bufferInfo);
 		DescriptorSetBuilder &addImageBinding(const vk::DescriptorSetLayoutBinding &binding, const vk::DescriptorImageInfo &imageInfo);
+		// array bindings take one info per element, so the number of infos has to be the descriptorCount of the binding
+		DescriptorSetBuilder &addBufferBinding(const vk::DescriptorSetLayoutBinding &binding, std::span<const vk::DescriptorBufferInfo> bufferInfos);
+		DescriptorSetBuilder &addImageBinding(const vk::DescriptorSetLayoutBinding &binding, std::span<const vk::DescriptorImageInfo> imageInfos);
+		// build returns a cached set instead of allocating a new one, if the cache has a set with identical contents.
+		DescriptorSetBuilder &setSetCache(DescriptorSetCache *setCache);
 		vk::DescriptorSet build();
+		// Removes all bindings but keeps their storage, so one builder can stage or build many sets without allocating.
+		DescriptorSetBuilder &clear();
 
 	private:
+		friend class DescriptorSetBatch;
+
+		void writeDescriptorSet(vk::DescriptorSet set);
+
 		GeneralDescriptorSetAllocator *alloc;
-		DescriptorSetLayoutCache *layoutCache;
+		DescriptorSetLayoutCache *layoutCache{nullptr};
+		DescriptorSetCache *setCache{nullptr};
 		vk::DescriptorSetLayout setLayout;
 
-		std::vector<std::pair<vk::DescriptorSetLayoutBinding, vk::DescriptorBufferInfo>> bufferBindings;
-		std::vector<std::pair<vk::DescriptorSetLayoutBinding, vk::DescriptorImageInfo>> imageBindings;
+		// every binding takes the next descriptorCount infos
+		std::vector<vk::DescriptorSetLayoutBinding> bufferBindings;
+		std::vector<vk::DescriptorBufferInfo> bufferInfos;
+		std::vector<vk::DescriptorSetLayoutBinding> imageBindings;
+		std::vector<vk::DescriptorImageInfo> imageInfos;
 	};
 
 #if defined(VULKANHELPER_IMPLEMENTATION)
@@ -420,74 +1041,509 @@ namespace vkh {
 	}
 
 	DescriptorSetBuilder &DescriptorSetBuilder::addBufferBinding(const vk::DescriptorSetLayoutBinding &binding, const vk::DescriptorBufferInfo &bufferInfo) {
-		bufferBindings.emplace_back(binding, bufferInfo);
-		return *this;
+		return addBufferBinding(binding, std::span<const vk::DescriptorBufferInfo>{&bufferInfo, 1});
 	}
 	DescriptorSetBuilder &DescriptorSetBuilder::addImageBinding(const vk::DescriptorSetLayoutBinding &binding, const vk::DescriptorImageInfo &imageInfo) {
-		imageBindings.emplace_back(binding, imageInfo);
+		return addImageBinding(binding, std::span<const vk::DescriptorImageInfo>{&imageInfo, 1});
+	}
+	DescriptorSetBuilder &DescriptorSetBuilder::addBufferBinding(const vk::DescriptorSetLayoutBinding &binding, std::span<const vk::DescriptorBufferInfo> bufferInfos) {
+		assert(bufferInfos.size() == binding.descriptorCount);
+		bufferBindings.push_back(binding);
+		this->bufferInfos.insert(this->bufferInfos.end(), bufferInfos.begin(), bufferInfos.end());
+		return *this;
+	}
+	DescriptorSetBuilder &DescriptorSetBuilder::addImageBinding(const vk::DescriptorSetLayoutBinding &binding, std::span<const vk::DescriptorImageInfo> imageInfos) {
+		assert(imageInfos.size() == binding.descriptorCount);
+		imageBindings.push_back(binding);
+		this->imageInfos.insert(this->imageInfos.end(), imageInfos.begin(), imageInfos.end());
+		return *this;
+	}
+	DescriptorSetBuilder &DescriptorSetBuilder::setSetCache(DescriptorSetCache *setCache) {
+		this->setCache = setCache;
+		return *this;
+	}
+	DescriptorSetBuilder &DescriptorSetBuilder::clear() {
+		bufferBindings.clear();
+		bufferInfos.clear();
+		imageBindings.clear();
+		imageInfos.clear();
+		// a layout from the cache belongs to the old bindings
+		if (layoutCache) {
+			setLayout = nullptr;
+		}
 		return *this;
 	}
 	vk::DescriptorSet DescriptorSetBuilder::build() {
+		// the bindings and payload are only needed for the cache lookups, usage tracking and the update template,
+		// so keep them on the stack whenever they fit
+		constexpr std::size_t INLINE_BINDING_COUNT = 16;
+		constexpr std::size_t INLINE_DESCRIPTOR_COUNT = 32;
+		std::array<vk::DescriptorSetLayoutBinding, INLINE_BINDING_COUNT> inlineBindings;
+		std::array<DescriptorUpdatePayload, INLINE_DESCRIPTOR_COUNT> inlinePayload;
+		std::vector<vk::DescriptorSetLayoutBinding> heapBindings;
+		std::vector<DescriptorUpdatePayload> heapPayload;
+		const std::size_t bindingCount = bufferBindings.size() + imageBindings.size();
+		const std::size_t descriptorCount = bufferInfos.size() + imageInfos.size();
+		vk::DescriptorSetLayoutBinding *bindings = inlineBindings.data();
+		DescriptorUpdatePayload *payload = inlinePayload.data();
+		if (bindingCount > INLINE_BINDING_COUNT) {
+			heapBindings.resize(bindingCount);
+			bindings = heapBindings.data();
+		}
+		if (descriptorCount > INLINE_DESCRIPTOR_COUNT) {
+			heapPayload.resize(descriptorCount);
+			payload = heapPayload.data();
+		}
+		// the infos of every binding follow each other, so the payload is all buffer infos, then all image infos,
+		// which is one element per descriptor in the order of the bindings, like the update template and the set cache expect
+		std::copy(bufferBindings.begin(), bufferBindings.end(), bindings);
+		std::copy(imageBindings.begin(), imageBindings.end(), bindings + bufferBindings.size());
+		for (std::size_t i = 0; i < bufferInfos.size(); ++i) {
+			payload[i].buffer = bufferInfos[i];
+		}
+		for (std::size_t i = 0; i < imageInfos.size(); ++i) {
+			payload[bufferInfos.size() + i].image = imageInfos[i];
+		}
+		const std::span<const vk::DescriptorSetLayoutBinding> bindingSpan{bindings, bindingCount};
+		const std::span<const DescriptorUpdatePayload> payloadSpan{payload, descriptorCount};
+
 		if (!setLayout) {
-			std::vector<vk::DescriptorSetLayoutBinding> bindings;
-			bindings.reserve(bufferBindings.size() + imageBindings.size());
-			for (auto &[binding, bufferInfo] : bufferBindings) {
-				bindings.emplace_back(binding);
-			}
-			for (auto &[binding, imageInfo] : imageBindings) {
-				bindings.emplace_back(binding);
+			setLayout = layoutCache->getLayout(bindingSpan);
+		}
+
+		if (setCache) {
+			if (auto cachedSet = setCache->find(setLayout, bindingSpan, payloadSpan)) {
+				return *cachedSet;
 			}
-			setLayout = layoutCache->getLayout(bindings);
 		}
 
-		vk::DescriptorSet set = alloc->allocate(setLayout);
+		vk::DescriptorSet set = alloc->allocate(setLayout, bindingSpan);
+
+		if (layoutCache) {
+			// the cast selects the raw pointer overload, the templated overload would pass the address of the pointer itself
+			alloc->device.updateDescriptorSetWithTemplate(set, layoutCache->getUpdateTemplate(bindingSpan), static_cast<const void *>(payload));
+		} else {
+			writeDescriptorSet(set);
+		}
 
+		if (setCache) {
+			setCache->insert(setLayout, bindingSpan, payloadSpan, set);
+		}
+		return set;
+	}
+	void DescriptorSetBuilder::writeDescriptorSet(vk::DescriptorSet set) {
 		std::vector<vk::WriteDescriptorSet> writes;
 		writes.reserve(bufferBindings.size() + imageBindings.size());
-		for (auto &[binding, bufferInfo] : bufferBindings) {
-			writes.push_back(
-				vk::WriteDescriptorSet{
-					.dstSet = set,
-					.dstBinding = binding.binding,
-					.descriptorCount = binding.descriptorCount,
-					.descriptorType = binding.descriptorType,
-					.pBufferInfo = &bufferInfo});
+		std::size_t infoIndex = 0;
+		for (auto &binding : bufferBindings) {
+			// a write needs at least one descriptor, an empty binding has nothing to write anyway
+			if (binding.descriptorCount > 0) {
+				writes.push_back(
+					vk::WriteDescriptorSet{
+						.dstSet = set,
+						.dstBinding = binding.binding,
+						.descriptorCount = binding.descriptorCount,
+						.descriptorType = binding.descriptorType,
+						.pBufferInfo = &bufferInfos[infoIndex]});
+			}
+			infoIndex += binding.descriptorCount;
 		}
-		for (auto &[binding, imageInfo] : imageBindings) {
-			writes.push_back(
-				vk::WriteDescriptorSet{
-					.dstSet = set,
-					.dstBinding = binding.binding,
-					.descriptorCount = binding.descriptorCount,
-					.descriptorType = binding.descriptorType,
-					.pImageInfo = &imageInfo});
+		infoIndex = 0;
+		for (auto &binding : imageBindings) {
+			if (binding.descriptorCount > 0) {
+				writes.push_back(
+					vk::WriteDescriptorSet{
+						.dstSet = set,
+						.dstBinding = binding.binding,
+						.descriptorCount = binding.descriptorCount,
+						.descriptorType = binding.descriptorType,
+						.pImageInfo = &imageInfos[infoIndex]});
+			}
+			infoIndex += binding.descriptorCount;
 		}
 
 		alloc->device.updateDescriptorSets(writes, {});
-		return set;
 	}
 #endif
 
-	vk::DescriptorSetLayout createDescriptorLayout(vk::Device device, std::vector<vk::DescriptorSetLayoutBinding> binding);
-	vk::UniqueDescriptorSetLayout createDescriptorLayoutUnique(vk::Device device, std::vector<vk::DescriptorSetLayoutBinding> binding);
+	// Stages many descriptor sets, then allocates all of them with as few vkAllocateDescriptorSets as the pools allow
+	// and writes all of them with a single vkUpdateDescriptorSets.
+	// The bindings and infos are staged into storage of the batch, which is reused between flushes. Together with a
+	// single builder that is cleared after every stage, staging and flushing do not allocate once the storage has grown.
+	class DescriptorSetBatch {
+	public:
+		DescriptorSetBatch(GeneralDescriptorSetAllocator *alloc);
+
+		// Copies the bindings of the builder, the builder can be reused right away. The allocator of the builder is ignored.
+		// Returns the index of the set in the span returned by the next flush.
+		uint32_t stage(const DescriptorSetBuilder &builder);
+		// the returned sets stay valid until the next flush
+		std::span<const vk::DescriptorSet> flush();
+
+	private:
+		struct StagedWrite {
+			uint32_t setIndex;
+			vk::DescriptorSetLayoutBinding binding;
+			// index of the first info of the binding in either bufferInfos or imageInfos
+			uint32_t infoIndex;
+			bool isImage;
+		};
+
+		GeneralDescriptorSetAllocator *alloc;
+		std::vector<vk::DescriptorSetLayout> layouts;
+		std::vector<vk::DescriptorSetLayoutBinding> bindings;
+		std::vector<StagedWrite> stagedWrites;
+		std::vector<vk::DescriptorBufferInfo> bufferInfos;
+		std::vector<vk::DescriptorImageInfo> imageInfos;
+		std::vector<vk::WriteDescriptorSet> writes;
+		std::vector<vk::DescriptorSet> sets;
+	};
 
 #if defined(VULKANHELPER_IMPLEMENTATION)
-	vk::DescriptorSetLayout createDescriptorLayout(vk::Device device, std::vector<vk::DescriptorSetLayoutBinding> binding) {
-		vk::DescriptorSetLayoutCreateInfo createInfo{
-			.bindingCount = static_cast<uint32_t>(binding.size()),
-			.pBindings = binding.data()};
-		return device.createDescriptorSetLayout(createInfo);
+	DescriptorSetBatch::DescriptorSetBatch(GeneralDescriptorSetAllocator *alloc)
+		: alloc{alloc} {
+	}
+	uint32_t DescriptorSetBatch::stage(const DescriptorSetBuilder &builder) {
+		const auto setIndex = static_cast<uint32_t>(layouts.size());
+		const std::size_t firstBinding = bindings.size();
+
+		// the infos of a binding stay next to each other, so every write can point at its first info
+		auto infoIndex = static_cast<uint32_t>(bufferInfos.size());
+		for (auto &binding : builder.bufferBindings) {
+			if (binding.descriptorCount > 0) {
+				stagedWrites.push_back(StagedWrite{
+					.setIndex = setIndex,
+					.binding = binding,
+					.infoIndex = infoIndex,
+					.isImage = false,
+				});
+			}
+			infoIndex += binding.descriptorCount;
+			bindings.push_back(binding);
+		}
+		bufferInfos.insert(bufferInfos.end(), builder.bufferInfos.begin(), builder.bufferInfos.end());
+		infoIndex = static_cast<uint32_t>(imageInfos.size());
+		for (auto &binding : builder.imageBindings) {
+			if (binding.descriptorCount > 0) {
+				stagedWrites.push_back(StagedWrite{
+					.setIndex = setIndex,
+					.binding = binding,
+					.infoIndex = infoIndex,
+					.isImage = true,
+				});
+			}
+			infoIndex += binding.descriptorCount;
+			bindings.push_back(binding);
+		}
+		imageInfos.insert(imageInfos.end(), builder.imageInfos.begin(), builder.imageInfos.end());
+
+		vk::DescriptorSetLayout layout = builder.setLayout;
+		if (!layout) {
+			layout = builder.layoutCache->getLayout(std::span<const vk::DescriptorSetLayoutBinding>{bindings.data() + firstBinding, bindings.size() - firstBinding});
+		}
+		layouts.push_back(layout);
+		return setIndex;
 	}
+	std::span<const vk::DescriptorSet> DescriptorSetBatch::flush() {
+		if (layouts.empty()) {
+			return {};
+		}
 
-	vk::UniqueDescriptorSetLayout createDescriptorLayoutUnique(vk::Device device, std::vector<vk::DescriptorSetLayoutBinding> binding) {
-		vk::DescriptorSetLayoutCreateInfo createInfo{
-			.bindingCount = static_cast<uint32_t>(binding.size()),
-			.pBindings = binding.data()};
-		return device.createDescriptorSetLayoutUnique(createInfo);
+		sets.resize(layouts.size());
+		alloc->allocate(layouts, sets, bindings);
+
+		// the infos are not touched anymore from here on, so pointers into them stay valid until the update
+		writes.clear();
+		for (const auto &stagedWrite : stagedWrites) {
+			writes.push_back(vk::WriteDescriptorSet{
+				.dstSet = sets[stagedWrite.setIndex],
+				.dstBinding = stagedWrite.binding.binding,
+				.descriptorCount = stagedWrite.binding.descriptorCount,
+				.descriptorType = stagedWrite.binding.descriptorType,
+				.pImageInfo = stagedWrite.isImage ? &imageInfos[stagedWrite.infoIndex] : nullptr,
+				.pBufferInfo = stagedWrite.isImage ? nullptr : &bufferInfos[stagedWrite.infoIndex],
+			});
+		}
+		alloc->device.updateDescriptorSets(writes, {});
+
+		layouts.clear();
+		bindings.clear();
+		stagedWrites.clear();
+		bufferInfos.clear();
+		imageInfos.clear();
+		return sets;
 	}
 #endif
 
+	// One big descriptor set with one update after bind, partially bound descriptor array per descriptor type.
+	// Resources get registered once and are then referenced in shaders through their index, e.g. passed as push constant,
+	// so the set only has to be bound once per command buffer.
+	// Needs a device created with enableDescriptorIndexing, which enables update after bind for every type the device supports.
+	// Thread safe.
+	class BindlessDescriptorHeap {
+	public:
+		// The capacities become the bindings of the set, in the given order, and are clamped to the device limits.
+		// Supported types are samplers, sampled/storage/combined images and uniform/storage buffers.
+		// Throws if the physical device can't update descriptors of one of the types after binding.
+		BindlessDescriptorHeap(vk::Device device, vk::PhysicalDevice physicalDevice, std::vector<vk::DescriptorPoolSize> capacities = {}, vk::ShaderStageFlags stageFlags = vk::ShaderStageFlagBits::eAll);
+		BindlessDescriptorHeap(const BindlessDescriptorHeap &) = delete;
+		BindlessDescriptorHeap &operator=(const BindlessDescriptorHeap &) = delete;
+
+		// returns the index of the descriptor inside the array of its type
+		uint32_t registerBuffer(vk::DescriptorType type, const vk::DescriptorBufferInfo &bufferInfo);
+		uint32_t registerImage(vk::DescriptorType type, const vk::DescriptorImageInfo &imageInfo);
+		// Replaces the descriptor at an already registered index.
+		void update(vk::DescriptorType type, uint32_t index, const vk::DescriptorBufferInfo &bufferInfo);
+		void update(vk::DescriptorType type, uint32_t index, const vk::DescriptorImageInfo &imageInfo);
+		// The index gets reused by the next registration, so the gpu must not access it anymore.
+		void release(vk::DescriptorType type, uint32_t index);
+
+		vk::DescriptorSetLayout getLayout() const { return *layout; }
+		vk::DescriptorSet getSet() const { return set; }
+		// binding of the descriptor array of the given type
+		uint32_t getBinding(vk::DescriptorType type) const;
+
+	private:
+		struct DescriptorArray {
+			vk::DescriptorType type;
+			uint32_t capacity;
+			uint32_t nextIndex{0};
+			std::vector<uint32_t> freeIndices;
+		};
+
+		static bool isBufferType(vk::DescriptorType type);
+
+		DescriptorArray &getArray(vk::DescriptorType type);
+		uint32_t acquireIndex(DescriptorArray &array);
+		void write(const DescriptorArray &array, uint32_t index, const vk::DescriptorBufferInfo *bufferInfo, const vk::DescriptorImageInfo *imageInfo);
+
+		vk::Device device;
+		std::vector<DescriptorArray> arrays;
+		vk::UniqueDescriptorSetLayout layout;
+		vk::UniqueDescriptorPool pool;
+		vk::DescriptorSet set;
+		// guards the free lists and the host access to the set
+		std::mutex mutex;
+	};
+
+#if defined(VULKANHELPER_IMPLEMENTATION)
+	BindlessDescriptorHeap::BindlessDescriptorHeap(vk::Device device, vk::PhysicalDevice physicalDevice, std::vector<vk::DescriptorPoolSize> capacities, vk::ShaderStageFlags stageFlags)
+		: device{device} {
+		if (capacities.empty()) {
+			capacities = {
+				vk::DescriptorPoolSize{.type = vk::DescriptorType::eSampler, .descriptorCount = 1024u},
+				vk::DescriptorPoolSize{.type = vk::DescriptorType::eSampledImage, .descriptorCount = 16384u},
+				vk::DescriptorPoolSize{.type = vk::DescriptorType::eStorageImage, .descriptorCount = 4096u},
+				vk::DescriptorPoolSize{.type = vk::DescriptorType::eStorageBuffer, .descriptorCount = 16384u},
+			};
+		}
+
+		auto features = physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceDescriptorIndexingFeatures>();
+		const auto &indexingFeatures = features.get<vk::PhysicalDeviceDescriptorIndexingFeatures>();
+		auto updateAfterBindFeature = [&indexingFeatures](vk::DescriptorType type) -> std::pair<vk::Bool32, const char *> {
+			switch (type) {
+			case vk::DescriptorType::eSampler:
+			case vk::DescriptorType::eCombinedImageSampler:
+			case vk::DescriptorType::eSampledImage:
+				return {indexingFeatures.descriptorBindingSampledImageUpdateAfterBind, "descriptorBindingSampledImageUpdateAfterBind"};
+			case vk::DescriptorType::eStorageImage:
+				return {indexingFeatures.descriptorBindingStorageImageUpdateAfterBind, "descriptorBindingStorageImageUpdateAfterBind"};
+			case vk::DescriptorType::eUniformBuffer:
+				return {indexingFeatures.descriptorBindingUniformBufferUpdateAfterBind, "descriptorBindingUniformBufferUpdateAfterBind"};
+			case vk::DescriptorType::eStorageBuffer:
+				return {indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind, "descriptorBindingStorageBufferUpdateAfterBind"};
+			default:
+				throw std::runtime_error("error: descriptor type " + vk::to_string(type) + " is not supported by the bindless descriptor heap");
+			}
+		};
+
+		auto properties = physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceDescriptorIndexingProperties>();
+		const auto &limits = properties.get<vk::PhysicalDeviceDescriptorIndexingProperties>();
+		auto maxDescriptorCount = [&limits](vk::DescriptorType type) -> uint32_t {
+			switch (type) {
+			case vk::DescriptorType::eSampler:
+				return limits.maxDescriptorSetUpdateAfterBindSamplers;
+			case vk::DescriptorType::eCombinedImageSampler:
+				return std::min(limits.maxDescriptorSetUpdateAfterBindSamplers, limits.maxDescriptorSetUpdateAfterBindSampledImages);
+			case vk::DescriptorType::eSampledImage:
+				return limits.maxDescriptorSetUpdateAfterBindSampledImages;
+			case vk::DescriptorType::eStorageImage:
+				return limits.maxDescriptorSetUpdateAfterBindStorageImages;
+			case vk::DescriptorType::eUniformBuffer:
+				return limits.maxDescriptorSetUpdateAfterBindUniformBuffers;
+			case vk::DescriptorType::eStorageBuffer:
+				return limits.maxDescriptorSetUpdateAfterBindStorageBuffers;
+			default:
+				throw std::runtime_error("error: descriptor type " + vk::to_string(type) + " is not supported by the bindless descriptor heap");
+			}
+		};
+
+		std::vector<vk::DescriptorSetLayoutBinding> bindings;
+		std::vector<vk::DescriptorBindingFlags> bindingFlags;
+		for (auto &capacity : capacities) {
+			assert(std::none_of(arrays.begin(), arrays.end(), [&](const DescriptorArray &array) { return array.type == capacity.type; }));
+			if (auto [supported, name] = updateAfterBindFeature(capacity.type); !supported) {
+				throw std::runtime_error("error: bindless " + vk::to_string(capacity.type) + " descriptors need " + name + ", which the physical device does not support");
+			}
+			const uint32_t maxCount = maxDescriptorCount(capacity.type);
+			if (capacity.descriptorCount > maxCount) {
+				std::cerr << "vulkan helper warning: bindless " << vk::to_string(capacity.type) << " capacity of " << capacity.descriptorCount << " got clamped to the device limit of " << maxCount << "\n";
+				capacity.descriptorCount = maxCount;
+			}
+
+			bindings.push_back(vk::DescriptorSetLayoutBinding{
+				.binding = static_cast<uint32_t>(arrays.size()),
+				.descriptorType = capacity.type,
+				.descriptorCount = capacity.descriptorCount,
+				.stageFlags = stageFlags,
+			});
+			bindingFlags.push_back(vk::DescriptorBindingFlagBits::eUpdateAfterBind | vk::DescriptorBindingFlagBits::ePartiallyBound);
+			arrays.push_back(DescriptorArray{.type = capacity.type, .capacity = capacity.descriptorCount});
+		}
+
+		vk::DescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{
+			.bindingCount = static_cast<uint32_t>(bindingFlags.size()),
+			.pBindingFlags = bindingFlags.data(),
+		};
+		layout = device.createDescriptorSetLayoutUnique(vk::DescriptorSetLayoutCreateInfo{
+			.pNext = &bindingFlagsInfo,
+			.flags = vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool,
+			.bindingCount = static_cast<uint32_t>(bindings.size()),
+			.pBindings = bindings.data(),
+		});
+		pool = device.createDescriptorPoolUnique(vk::DescriptorPoolCreateInfo{
+			.flags = vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind,
+			.maxSets = 1,
+			.poolSizeCount = static_cast<uint32_t>(capacities.size()),
+			.pPoolSizes = capacities.data(),
+		});
+		set = device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo{
+			.descriptorPool = *pool,
+			.descriptorSetCount = 1,
+			.pSetLayouts = &*layout,
+		})[0];
+	}
+
+	uint32_t BindlessDescriptorHeap::registerBuffer(vk::DescriptorType type, const vk::DescriptorBufferInfo &bufferInfo) {
+		assert(isBufferType(type));
+		std::lock_guard lock{mutex};
+		auto &array = getArray(type);
+		const uint32_t index = acquireIndex(array);
+		write(array, index, &bufferInfo, nullptr);
+		return index;
+	}
+	uint32_t BindlessDescriptorHeap::registerImage(vk::DescriptorType type, const vk::DescriptorImageInfo &imageInfo) {
+		assert(!isBufferType(type));
+		std::lock_guard lock{mutex};
+		auto &array = getArray(type);
+		const uint32_t index = acquireIndex(array);
+		write(array, index, nullptr, &imageInfo);
+		return index;
+	}
+	void BindlessDescriptorHeap::update(vk::DescriptorType type, uint32_t index, const vk::DescriptorBufferInfo &bufferInfo) {
+		assert(isBufferType(type));
+		std::lock_guard lock{mutex};
+		write(getArray(type), index, &bufferInfo, nullptr);
+	}
+	void BindlessDescriptorHeap::update(vk::DescriptorType type, uint32_t index, const vk::DescriptorImageInfo &imageInfo) {
+		assert(!isBufferType(type));
+		std::lock_guard lock{mutex};
+		write(getArray(type), index, nullptr, &imageInfo);
+	}
+	void BindlessDescriptorHeap::release(vk::DescriptorType type, uint32_t index) {
+		std::lock_guard lock{mutex};
+		auto &array = getArray(type);
+		assert(index < array.nextIndex);
+		// partially bound arrays allow the stale descriptor to stay in place until the index gets reused
+		array.freeIndices.push_back(index);
+	}
+	uint32_t BindlessDescriptorHeap::getBinding(vk::DescriptorType type) const {
+		for (uint32_t binding = 0; binding < arrays.size(); binding++) {
+			if (arrays[binding].type == type) {
+				return binding;
+			}
+		}
+		throw std::runtime_error("error: the bindless descriptor heap has no array for descriptor type " + vk::to_string(type));
+	}
+
+	bool BindlessDescriptorHeap::isBufferType(vk::DescriptorType type) {
+		return type == vk::DescriptorType::eUniformBuffer || type == vk::DescriptorType::eStorageBuffer;
+	}
+	BindlessDescriptorHeap::DescriptorArray &BindlessDescriptorHeap::getArray(vk::DescriptorType type) {
+		return arrays[getBinding(type)];
+	}
+	uint32_t BindlessDescriptorHeap::acquireIndex(DescriptorArray &array) {
+		if (!array.freeIndices.empty()) {
+			const uint32_t index = array.freeIndices.back();
+			array.freeIndices.pop_back();
+			return index;
+		}
+		if (array.nextIndex == array.capacity) {
+			throw std::runtime_error("error: the bindless descriptor heap is out of " + vk::to_string(array.type) + " descriptors");
+		}
+		return array.nextIndex++;
+	}
+	void BindlessDescriptorHeap::write(const DescriptorArray &array, uint32_t index, const vk::DescriptorBufferInfo *bufferInfo, const vk::DescriptorImageInfo *imageInfo) {
+		assert(index < array.capacity);
+		device.updateDescriptorSets(vk::WriteDescriptorSet{
+										.dstSet = set,
+										.dstBinding = static_cast<uint32_t>(&array - arrays.data()),
+										.dstArrayElement = index,
+										.descriptorCount = 1,
+										.descriptorType = array.type,
+										.pImageInfo = imageInfo,
+										.pBufferInfo = bufferInfo,
+									},
+									{});
+	}
+#endif
+
+	vk::DescriptorSetLayout createDescriptorLayout(vk::Device device, std::vector<vk::DescriptorSetLayoutBinding> binding);
+	vk::UniqueDescriptorSetLayout createDescriptorLayoutUnique(vk::Device device, std::vector<vk::DescriptorSetLayoutBinding> binding);
+
+#if defined(VULKANHELPER_IMPLEMENTATION)
+	vk::DescriptorSetLayout createDescriptorLayout(vk::Device device, std::vector<vk::DescriptorSetLayoutBinding> binding) {
+		vk::DescriptorSetLayoutCreateInfo createInfo{
+			.bindingCount = static_cast<uint32_t>(binding.size()),
+			.pBindings = binding.data()};
+		return device.createDescriptorSetLayout(createInfo);
+	}
+
+	vk::UniqueDescriptorSetLayout createDescriptorLayoutUnique(vk::Device device, std::vector<vk::DescriptorSetLayoutBinding> binding) {
+		vk::DescriptorSetLayoutCreateInfo createInfo{
+			.bindingCount = static_cast<uint32_t>(binding.size()),
+			.pBindings = binding.data()};
+		return device.createDescriptorSetLayoutUnique(createInfo);
+	}
+#endif
+
+	struct ReflectedVertexInput {
+		uint32_t location;
+		vk::Format format;
+	};
+
+	// everything the helpers reflect from one shader stage
+	struct ShaderReflection {
+		vk::ShaderStageFlagBits stage;
+		std::unordered_map<uint32_t, std::unordered_map<uint32_t, vk::DescriptorSetLayoutBinding>> setBindings;
+		std::vector<vk::PushConstantRange> pushConstants;
+		// only filled for vertex shaders, sorted by location, built-ins are skipped
+		std::vector<ReflectedVertexInput> vertexInputs;
+	};
+
+	// Reflects the spv with the builtin scanner. The result is memoized by the content of the spv and the stage,
+	// so shaders shared by many pipelines are only reflected once. Thread safe.
+	// The returned reference stays valid until the program ends.
+	const ShaderReflection &reflectShader(const std::vector<uint32_t> &spv, vk::ShaderStageFlagBits shaderStage);
+	// Uncached reflection with the builtin scanner. It makes one linear pass over the words, only the push constant
+	// block sizes look at the decorations a second time. Besides the result, it only uses a per thread scratch table
+	// that is reused between calls. Throws on malformed spv.
+	ShaderReflection reflectShaderBuiltin(std::span<const uint32_t> spv, vk::ShaderStageFlagBits shaderStage);
 #if defined(VULKANHELPER_USE_SPIRV_REFLECT)
+	// Uncached reflection with SPIRV-Reflect, mainly useful for cross checking the builtin scanner
+	ShaderReflection reflectShaderSpirvReflect(const std::vector<uint32_t> &spv, vk::ShaderStageFlagBits shaderStage);
+#endif
+
 	std::unordered_map<uint32_t, std::unordered_map<uint32_t, vk::DescriptorSetLayoutBinding>>
 	reflectSetBindings(const std::vector<uint32_t> &spv, vk::ShaderStageFlagBits shaderStage);
 
@@ -498,10 +1554,7 @@ namespace vkh {
 	std::vector<vk::PushConstantRange> reflectPushConstants(const std::vector<uint32_t> &spv, vk::ShaderStageFlagBits shaderStage);
 	std::vector<vk::PushConstantRange> mergeReflectedPushConstants(const std::vector<std::vector<vk::PushConstantRange>> &pushConstantsRanges);
 
-#endif
-
 #if defined(VULKANHELPER_IMPLEMENTATION)
-#if defined(VULKANHELPER_USE_SPIRV_REFLECT)
 	std::vector<vk::PushConstantRange> mergeReflectedPushConstants(const std::vector<std::vector<vk::PushConstantRange>> &pushConstantsRanges) {
 		std::vector<vk::PushConstantRange> ret;
 		for (auto &ranges : pushConstantsRanges) {
@@ -517,44 +1570,430 @@ namespace vkh {
 		return std::move(ret);
 	}
 	std::vector<vk::PushConstantRange> reflectPushConstants(const std::vector<uint32_t> &spv, vk::ShaderStageFlagBits shaderStage) {
-		SpvReflectShaderModule module = {};
-		SpvReflectResult result = spvReflectCreateShaderModule(spv.size() * sizeof(uint32_t), spv.data(), &module);
-		assert(result == SPV_REFLECT_RESULT_SUCCESS);
+		return reflectShader(spv, shaderStage).pushConstants;
+	}
+	std::unordered_map<uint32_t, std::unordered_map<uint32_t, vk::DescriptorSetLayoutBinding>>
+	reflectSetBindings(const std::vector<uint32_t> &spv, vk::ShaderStageFlagBits shaderStage) {
+		return reflectShader(spv, shaderStage).setBindings;
+	}
 
-		uint32_t count = 0;
-		result = spvReflectEnumeratePushConstantBlocks(&module, &count, NULL);
+	// Walks the SPIR-V word stream, see the SPIR-V specification for the opcodes and operands.
+	// Decorations come before types, types before global variables and those before any function,
+	// so every global variable can be reflected right when it is reached.
+	class SpirvScanner {
+	public:
+		static constexpr uint32_t NONE = ~0u;
+
+		struct Id {
+			// instruction defining the id, only recorded for types and constants
+			uint32_t opcode{NONE};
+			uint32_t wordOffset{0};
+			uint32_t descriptorSet{NONE};
+			uint32_t binding{NONE};
+			uint32_t location{NONE};
+			uint32_t arrayStride{NONE};
+			// set on built-in variables and on structs with built-in members
+			bool builtIn{false};
+			bool bufferBlock{false};
+		};
 
-		std::vector<SpvReflectBlockVariable *> blocks(count);
-		result = spvReflectEnumeratePushConstantBlocks(&module, &count, blocks.data());
-		assert(result == SPV_REFLECT_RESULT_SUCCESS);
+		SpirvScanner(std::span<const uint32_t> words, std::vector<Id> &ids)
+			: words{words}, ids{ids} {
+		}
 
-		std::vector<vk::PushConstantRange> ret;
-		for (auto *block : blocks) {
-			ret.push_back(vk::PushConstantRange{
-				.stageFlags = shaderStage,
-				.offset = block->offset,
-				.size = block->size,
+		ShaderReflection scan(vk::ShaderStageFlagBits shaderStage);
+
+	private:
+		enum Op : uint32_t {
+			OpTypeVoid = 19,
+			OpTypeBool = 20,
+			OpTypeInt = 21,
+			OpTypeFloat = 22,
+			OpTypeVector = 23,
+			OpTypeMatrix = 24,
+			OpTypeImage = 25,
+			OpTypeSampler = 26,
+			OpTypeSampledImage = 27,
+			OpTypeArray = 28,
+			OpTypeRuntimeArray = 29,
+			OpTypeStruct = 30,
+			OpTypePointer = 32,
+			OpTypeForwardPointer = 39,
+			OpConstant = 43,
+			OpSpecConstant = 50,
+			OpFunction = 54,
+			OpVariable = 59,
+			OpDecorate = 71,
+			OpMemberDecorate = 72,
+			OpTypeAccelerationStructureKHR = 5341,
+		};
+		enum Decoration : uint32_t {
+			BufferBlock = 3,
+			RowMajor = 4,
+			ArrayStride = 6,
+			MatrixStride = 7,
+			BuiltIn = 11,
+			Location = 30,
+			Binding = 33,
+			DescriptorSet = 34,
+			Offset = 35,
+		};
+		enum StorageClass : uint32_t {
+			Input = 1,
+			PushConstant = 9,
+			StorageBuffer = 12,
+		};
+		enum Dim : uint32_t {
+			DimBuffer = 5,
+			DimSubpassData = 6,
+		};
+
+		Id &at(uint32_t id);
+		// operand index 0 is the first word after the opcode
+		uint32_t operand(const Id &id, uint32_t index) const;
+		uint32_t wordCount(const Id &id) const { return words[id.wordOffset] >> 16; }
+		// word count up to the last operand the scanner reads of the opcode
+		static uint32_t minimumWordCount(uint32_t opcode);
+
+		void reflectVariable(std::size_t wordOffset, ShaderReflection &reflection);
+		std::optional<vk::DescriptorType> descriptorType(uint32_t typeId, uint32_t storageClass);
+		vk::PushConstantRange pushConstantRange(uint32_t structId, vk::ShaderStageFlagBits shaderStage);
+		vk::Format vertexInputFormat(uint32_t typeId);
+		uint32_t constantValue(uint32_t id);
+		uint32_t typeSize(uint32_t typeId, uint32_t matrixStride, bool rowMajor);
+		uint32_t memberDecoration(uint32_t structId, uint32_t member, uint32_t decoration) const;
+
+		std::span<const uint32_t> words;
+		std::vector<Id> &ids;
+		// range of the annotation instructions, searched again for member decorations of push constant blocks
+		std::size_t annotationBegin{0};
+		std::size_t annotationEnd{0};
+	};
+
+	ShaderReflection SpirvScanner::scan(vk::ShaderStageFlagBits shaderStage) {
+		constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+		constexpr std::size_t HEADER_WORD_COUNT = 5;
+		if (words.size() < HEADER_WORD_COUNT || words[0] != SPIRV_MAGIC) {
+			throw std::runtime_error("error: spv has no valid SPIR-V header");
+		}
+		// assign only reallocates when the scratch table of this thread is too small
+		ids.assign(words[3], Id{});
+
+		ShaderReflection reflection{.stage = shaderStage};
+		for (std::size_t offset = HEADER_WORD_COUNT; offset < words.size();) {
+			const uint32_t instructionWordCount = words[offset] >> 16;
+			const uint32_t opcode = words[offset] & 0xffff;
+			if (instructionWordCount < minimumWordCount(opcode) || offset + instructionWordCount > words.size()) {
+				throw std::runtime_error("error: spv contains a malformed instruction");
+			}
+
+			if (opcode == OpFunction) {
+				// only function local variables follow
+				break;
+			} else if (opcode == OpDecorate || opcode == OpMemberDecorate) {
+				if (annotationEnd == 0) {
+					annotationBegin = offset;
+				}
+				annotationEnd = offset + instructionWordCount;
+
+				Id &target = at(words[offset + 1]);
+				if (opcode == OpMemberDecorate) {
+					if (words[offset + 3] == BuiltIn) {
+						target.builtIn = true;
+					}
+				} else {
+					const uint32_t value = instructionWordCount > 3 ? words[offset + 3] : 0;
+					switch (words[offset + 2]) {
+					case DescriptorSet:
+						target.descriptorSet = value;
+						break;
+					case Binding:
+						target.binding = value;
+						break;
+					case Location:
+						target.location = value;
+						break;
+					case ArrayStride:
+						target.arrayStride = value;
+						break;
+					case BuiltIn:
+						target.builtIn = true;
+						break;
+					case BufferBlock:
+						target.bufferBlock = true;
+						break;
+					}
+				}
+			} else if (opcode == OpConstant || opcode == OpSpecConstant) {
+				Id &constant = at(words[offset + 2]);
+				constant.opcode = opcode;
+				constant.wordOffset = static_cast<uint32_t>(offset);
+			} else if (opcode == OpVariable) {
+				reflectVariable(offset, reflection);
+			} else if ((opcode >= OpTypeVoid && opcode < OpTypeForwardPointer) || opcode == OpTypeAccelerationStructureKHR) {
+				Id &type = at(words[offset + 1]);
+				type.opcode = opcode;
+				type.wordOffset = static_cast<uint32_t>(offset);
+			}
+			offset += instructionWordCount;
+		}
+
+		std::sort(reflection.vertexInputs.begin(), reflection.vertexInputs.end(), [](const auto &a, const auto &b) {
+			return a.location < b.location;
+		});
+		return reflection;
+	}
+
+	uint32_t SpirvScanner::operand(const Id &id, uint32_t index) const {
+		// ids without a recorded instruction would otherwise read the header
+		if (id.opcode == NONE || index + 1 >= wordCount(id)) {
+			throw std::runtime_error("error: spv refers to an undefined id or an instruction with too few operands");
+		}
+		return words[id.wordOffset + 1 + index];
+	}
+
+	uint32_t SpirvScanner::minimumWordCount(uint32_t opcode) {
+		switch (opcode) {
+		case OpDecorate:
+		case OpTypeFloat:
+		case OpTypeSampledImage:
+		case OpTypeRuntimeArray:
+			return 3;
+		case OpMemberDecorate:
+		case OpConstant:
+		case OpSpecConstant:
+		case OpVariable:
+		case OpTypeInt:
+		case OpTypeVector:
+		case OpTypeMatrix:
+		case OpTypeArray:
+		case OpTypePointer:
+			return 4;
+		case OpTypeImage:
+			return 9;
+		case OpTypeAccelerationStructureKHR:
+			return 2;
+		default:
+			// every other type still has its result id
+			return opcode >= OpTypeVoid && opcode < OpTypeForwardPointer ? 2 : 1;
+		}
+	}
+
+	SpirvScanner::Id &SpirvScanner::at(uint32_t id) {
+		if (id >= ids.size()) {
+			throw std::runtime_error("error: spv uses an id outside of its id bound");
+		}
+		return ids[id];
+	}
+
+	void SpirvScanner::reflectVariable(std::size_t wordOffset, ShaderReflection &reflection) {
+		const Id &pointerType = at(words[wordOffset + 1]);
+		const Id &variable = at(words[wordOffset + 2]);
+		const uint32_t storageClass = words[wordOffset + 3];
+		if (pointerType.opcode != OpTypePointer) {
+			throw std::runtime_error("error: spv contains a variable that is not of pointer type");
+		}
+		const uint32_t pointeeTypeId = operand(pointerType, 2);
+
+		if (variable.binding != NONE) {
+			// arrays of descriptors, runtime arrays are reported with a count of 0 like SPIRV-Reflect does
+			uint32_t count = 1;
+			uint32_t typeId = pointeeTypeId;
+			for (const Id *type = &at(typeId); type->opcode == OpTypeArray || type->opcode == OpTypeRuntimeArray; type = &at(typeId)) {
+				count = type->opcode == OpTypeArray ? count * constantValue(operand(*type, 2)) : 0;
+				typeId = operand(*type, 1);
+			}
+			if (auto type = descriptorType(typeId, storageClass)) {
+				const uint32_t set = variable.descriptorSet == NONE ? 0 : variable.descriptorSet;
+				reflection.setBindings[set][variable.binding] = vk::DescriptorSetLayoutBinding{
+					.binding = variable.binding,
+					.descriptorType = *type,
+					.descriptorCount = count,
+					.stageFlags = reflection.stage,
+				};
+			}
+		} else if (storageClass == PushConstant) {
+			reflection.pushConstants.push_back(pushConstantRange(pointeeTypeId, reflection.stage));
+		} else if (storageClass == Input && reflection.stage == vk::ShaderStageFlagBits::eVertex && variable.location != NONE &&
+				   !variable.builtIn && !at(pointeeTypeId).builtIn) {
+			reflection.vertexInputs.push_back(ReflectedVertexInput{
+				.location = variable.location,
+				.format = vertexInputFormat(pointeeTypeId),
 			});
 		}
-		return std::move(ret);
 	}
-	std::unordered_map<uint32_t, std::unordered_map<uint32_t, vk::DescriptorSetLayoutBinding>>
-	reflectSetBindings(const std::vector<uint32_t> &spv, vk::ShaderStageFlagBits shaderStage) {
+
+	std::optional<vk::DescriptorType> SpirvScanner::descriptorType(uint32_t typeId, uint32_t storageClass) {
+		const Id &type = at(typeId);
+		switch (type.opcode) {
+		case OpTypeSampler:
+			return vk::DescriptorType::eSampler;
+		case OpTypeSampledImage:
+			return vk::DescriptorType::eCombinedImageSampler;
+		case OpTypeImage: {
+			// sampled is 2 for images used without a sampler
+			const bool storage = operand(type, 6) == 2;
+			switch (operand(type, 2)) {
+			case DimBuffer:
+				return storage ? vk::DescriptorType::eStorageTexelBuffer : vk::DescriptorType::eUniformTexelBuffer;
+			case DimSubpassData:
+				return vk::DescriptorType::eInputAttachment;
+			default:
+				return storage ? vk::DescriptorType::eStorageImage : vk::DescriptorType::eSampledImage;
+			}
+		}
+		case OpTypeStruct:
+			return storageClass == StorageBuffer || type.bufferBlock ? vk::DescriptorType::eStorageBuffer : vk::DescriptorType::eUniformBuffer;
+		case OpTypeAccelerationStructureKHR:
+			return vk::DescriptorType::eAccelerationStructureKHR;
+		default:
+			return std::nullopt;
+		}
+	}
+
+	vk::PushConstantRange SpirvScanner::pushConstantRange(uint32_t structId, vk::ShaderStageFlagBits shaderStage) {
+		const Id &type = at(structId);
+		uint32_t begin = NONE;
+		uint32_t end = 0;
+		if (type.opcode == OpTypeStruct) {
+			for (uint32_t member = 0; member + 2 < wordCount(type); member++) {
+				const uint32_t memberOffset = memberDecoration(structId, member, Offset);
+				const uint32_t offset = memberOffset == NONE ? 0 : memberOffset;
+				begin = std::min(begin, offset);
+				end = std::max(end, offset + typeSize(operand(type, member + 1), memberDecoration(structId, member, MatrixStride), memberDecoration(structId, member, RowMajor) != NONE));
+			}
+		}
+		return vk::PushConstantRange{
+			.stageFlags = shaderStage,
+			.offset = begin == NONE ? 0 : begin,
+			.size = begin == NONE ? 0 : end - begin,
+		};
+	}
+
+	vk::Format SpirvScanner::vertexInputFormat(uint32_t typeId) {
+		// formats indexed by [width][component count - 1][unsigned, signed, float]
+		constexpr vk::Format FORMATS[3][4][3] = {
+			{
+				{vk::Format::eR16Uint, vk::Format::eR16Sint, vk::Format::eR16Sfloat},
+				{vk::Format::eR16G16Uint, vk::Format::eR16G16Sint, vk::Format::eR16G16Sfloat},
+				{vk::Format::eR16G16B16Uint, vk::Format::eR16G16B16Sint, vk::Format::eR16G16B16Sfloat},
+				{vk::Format::eR16G16B16A16Uint, vk::Format::eR16G16B16A16Sint, vk::Format::eR16G16B16A16Sfloat},
+			},
+			{
+				{vk::Format::eR32Uint, vk::Format::eR32Sint, vk::Format::eR32Sfloat},
+				{vk::Format::eR32G32Uint, vk::Format::eR32G32Sint, vk::Format::eR32G32Sfloat},
+				{vk::Format::eR32G32B32Uint, vk::Format::eR32G32B32Sint, vk::Format::eR32G32B32Sfloat},
+				{vk::Format::eR32G32B32A32Uint, vk::Format::eR32G32B32A32Sint, vk::Format::eR32G32B32A32Sfloat},
+			},
+			{
+				{vk::Format::eR64Uint, vk::Format::eR64Sint, vk::Format::eR64Sfloat},
+				{vk::Format::eR64G64Uint, vk::Format::eR64G64Sint, vk::Format::eR64G64Sfloat},
+				{vk::Format::eR64G64B64Uint, vk::Format::eR64G64B64Sint, vk::Format::eR64G64B64Sfloat},
+				{vk::Format::eR64G64B64A64Uint, vk::Format::eR64G64B64A64Sint, vk::Format::eR64G64B64A64Sfloat},
+			},
+		};
+
+		const Id *scalar = &at(typeId);
+		uint32_t componentCount = 1;
+		if (scalar->opcode == OpTypeVector) {
+			componentCount = operand(*scalar, 2);
+			scalar = &at(operand(*scalar, 1));
+		}
+		if ((scalar->opcode != OpTypeInt && scalar->opcode != OpTypeFloat) || componentCount < 1 || componentCount > 4) {
+			return vk::Format::eUndefined;
+		}
+		const uint32_t width = operand(*scalar, 1);
+		const uint32_t kind = scalar->opcode == OpTypeFloat ? 2 : operand(*scalar, 2);
+		switch (width) {
+		case 16:
+			return FORMATS[0][componentCount - 1][kind];
+		case 32:
+			return FORMATS[1][componentCount - 1][kind];
+		case 64:
+			return FORMATS[2][componentCount - 1][kind];
+		default:
+			return vk::Format::eUndefined;
+		}
+	}
+
+	uint32_t SpirvScanner::constantValue(uint32_t id) {
+		const Id &constant = at(id);
+		if (constant.opcode != OpConstant && constant.opcode != OpSpecConstant) {
+			// lengths computed by spec constant operations are not evaluated
+			return 1;
+		}
+		return operand(constant, 2);
+	}
+
+	uint32_t SpirvScanner::typeSize(uint32_t typeId, uint32_t matrixStride, bool rowMajor) {
+		const Id &type = at(typeId);
+		switch (type.opcode) {
+		case OpTypeBool:
+			return 4;
+		case OpTypeInt:
+		case OpTypeFloat:
+			return operand(type, 1) / 8;
+		case OpTypeVector:
+			return operand(type, 2) * typeSize(operand(type, 1), NONE, false);
+		case OpTypeMatrix: {
+			const uint32_t columnCount = operand(type, 2);
+			if (matrixStride == NONE) {
+				return columnCount * typeSize(operand(type, 1), NONE, false);
+			}
+			const uint32_t rowCount = operand(at(operand(type, 1)), 2);
+			return (rowMajor ? rowCount : columnCount) * matrixStride;
+		}
+		case OpTypeArray: {
+			const uint32_t stride = type.arrayStride != NONE ? type.arrayStride : typeSize(operand(type, 1), matrixStride, rowMajor);
+			return constantValue(operand(type, 2)) * stride;
+		}
+		case OpTypeStruct: {
+			uint32_t end = 0;
+			for (uint32_t member = 0; member + 2 < wordCount(type); member++) {
+				const uint32_t offset = memberDecoration(typeId, member, Offset);
+				end = std::max(end, (offset == NONE ? 0 : offset) + typeSize(operand(type, member + 1), memberDecoration(typeId, member, MatrixStride), memberDecoration(typeId, member, RowMajor) != NONE));
+			}
+			return end;
+		}
+		case OpTypePointer:
+			// physical storage buffer pointers
+			return 8;
+		default:
+			return 0;
+		}
+	}
+
+	uint32_t SpirvScanner::memberDecoration(uint32_t structId, uint32_t member, uint32_t decoration) const {
+		for (std::size_t offset = annotationBegin; offset < annotationEnd; offset += words[offset] >> 16) {
+			const uint32_t instructionWordCount = words[offset] >> 16;
+			if ((words[offset] & 0xffff) == OpMemberDecorate && instructionWordCount > 3 &&
+				words[offset + 1] == structId && words[offset + 2] == member && words[offset + 3] == decoration) {
+				return instructionWordCount > 4 ? words[offset + 4] : 0;
+			}
+		}
+		return NONE;
+	}
+
+	ShaderReflection reflectShaderBuiltin(std::span<const uint32_t> spv, vk::ShaderStageFlagBits shaderStage) {
+		static thread_local std::vector<SpirvScanner::Id> ids;
+		return SpirvScanner{spv, ids}.scan(shaderStage);
+	}
+
+#if defined(VULKANHELPER_USE_SPIRV_REFLECT)
+	ShaderReflection reflectShaderSpirvReflect(const std::vector<uint32_t> &spv, vk::ShaderStageFlagBits shaderStage) {
 		SpvReflectShaderModule module = {};
 		SpvReflectResult result = spvReflectCreateShaderModule(spv.size() * sizeof(uint32_t), spv.data(), &module);
 		assert(result == SPV_REFLECT_RESULT_SUCCESS);
 
+		ShaderReflection reflection{.stage = shaderStage};
+
 		uint32_t count = 0;
 		result = spvReflectEnumerateDescriptorSets(&module, &count, NULL);
 		assert(result == SPV_REFLECT_RESULT_SUCCESS);
-
 		std::vector<SpvReflectDescriptorSet *> sets(count);
 		result = spvReflectEnumerateDescriptorSets(&module, &count, sets.data());
 		assert(result == SPV_REFLECT_RESULT_SUCCESS);
-
-		std::unordered_map<uint32_t, std::unordered_map<uint32_t, vk::DescriptorSetLayoutBinding>> setMap;
 		for (auto *set : sets) {
-			std::vector<vk::DescriptorSetLayoutBinding> bindings;
 			for (uint32_t i = 0; i < set->binding_count; i++) {
 				auto *reflBinding = set->bindings[i];
 
@@ -563,12 +2002,99 @@ namespace vkh {
 					.descriptorType = static_cast<vk::DescriptorType>(reflBinding->descriptor_type),
 					.descriptorCount = reflBinding->count,
 					.stageFlags = shaderStage};
-				setMap[set->set][binding.binding] = binding;
+				reflection.setBindings[set->set][binding.binding] = binding;
 			}
 		}
 
+		count = 0;
+		result = spvReflectEnumeratePushConstantBlocks(&module, &count, NULL);
+		assert(result == SPV_REFLECT_RESULT_SUCCESS);
+		std::vector<SpvReflectBlockVariable *> blocks(count);
+		result = spvReflectEnumeratePushConstantBlocks(&module, &count, blocks.data());
+		assert(result == SPV_REFLECT_RESULT_SUCCESS);
+		for (auto *block : blocks) {
+			// the block size is padded, the range is taken from the members to match the builtin scanner
+			uint32_t begin = UINT32_MAX;
+			uint32_t end = 0;
+			for (uint32_t i = 0; i < block->member_count; i++) {
+				begin = std::min(begin, block->members[i].offset);
+				end = std::max(end, block->members[i].offset + block->members[i].size);
+			}
+			reflection.pushConstants.push_back(vk::PushConstantRange{
+				.stageFlags = shaderStage,
+				.offset = block->member_count == 0 ? 0 : begin,
+				.size = block->member_count == 0 ? 0 : end - begin,
+			});
+		}
+
+		if (shaderStage == vk::ShaderStageFlagBits::eVertex) {
+			count = 0;
+			result = spvReflectEnumerateInputVariables(&module, &count, NULL);
+			assert(result == SPV_REFLECT_RESULT_SUCCESS);
+			std::vector<SpvReflectInterfaceVariable *> inputs(count);
+			result = spvReflectEnumerateInputVariables(&module, &count, inputs.data());
+			assert(result == SPV_REFLECT_RESULT_SUCCESS);
+			for (auto *input : inputs) {
+				if (input->decoration_flags & SPV_REFLECT_DECORATION_BUILT_IN) {
+					continue;
+				}
+				reflection.vertexInputs.push_back(ReflectedVertexInput{
+					.location = input->location,
+					.format = static_cast<vk::Format>(input->format),
+				});
+			}
+			std::sort(reflection.vertexInputs.begin(), reflection.vertexInputs.end(), [](const auto &a, const auto &b) {
+				return a.location < b.location;
+			});
+		}
+
 		spvReflectDestroyShaderModule(&module);
-		return std::move(setMap);
+		return reflection;
+	}
+#endif
+
+	const ShaderReflection &reflectShader(const std::vector<uint32_t> &spv, vk::ShaderStageFlagBits shaderStage) {
+		struct Entry {
+			std::vector<uint32_t> spv;
+			ShaderReflection reflection;
+		};
+		static std::mutex mutex;
+		static std::unordered_multimap<std::size_t, std::unique_ptr<Entry>> entries;
+
+		std::size_t hash = hashCombine(spv.size(), static_cast<std::size_t>(shaderStage));
+		for (uint32_t word : spv) {
+			hash = hashCombine(hash, word);
+		}
+		auto findEntry = [&]() -> const Entry * {
+			auto [begin, end] = entries.equal_range(hash);
+			for (auto iter = begin; iter != end; ++iter) {
+				if (iter->second->reflection.stage == shaderStage && iter->second->spv == spv) {
+					return iter->second.get();
+				}
+			}
+			return nullptr;
+		};
+
+		{
+			std::lock_guard lock{mutex};
+			if (const Entry *entry = findEntry()) {
+				return entry->reflection;
+			}
+		}
+
+		// reflect without holding the lock, if another thread was faster its result is used instead
+		auto entry = std::make_unique<Entry>(Entry{
+			.spv = spv,
+			.reflection = reflectShaderBuiltin(spv, shaderStage),
+		});
+
+		std::lock_guard lock{mutex};
+		if (const Entry *existingEntry = findEntry()) {
+			return existingEntry->reflection;
+		}
+		const ShaderReflection &reflection = entry->reflection;
+		entries.emplace(hash, std::move(entry));
+		return reflection;
 	}
 
 	std::vector<vk::DescriptorSetLayout> mergeReflectedSetBindings(
@@ -609,56 +2135,441 @@ namespace vkh {
 
 		return layouts;
 	}
+#endif
 
-#endif // #if defined(VULKANHELPER_USE_SPIRV_REFLECT)
-#endif // #if defined(VULKANHELPER_IMPLEMENTATION)
+	// Owns a pipeline cache that is loaded from disk on construction and written back on save() and destruction.
+	// Cache data from a different driver or physical device is detected by its header and discarded.
+	class PipelineCacheStore {
+	public:
+		PipelineCacheStore(vk::Device device, vk::PhysicalDevice physicalDevice, std::filesystem::path filePath);
+		PipelineCacheStore(const PipelineCacheStore &) = delete;
+		PipelineCacheStore &operator=(const PipelineCacheStore &) = delete;
+		~PipelineCacheStore();
 
-	vk::PipelineRasterizationStateCreateInfo makeDefaultRasterisationStateCreateInfo(vk::PolygonMode polygonMode);
+		vk::PipelineCache get() const;
+		vk::PipelineCache operator*() const;
 
-	vk::PipelineMultisampleStateCreateInfo makeDefaultMultisampleStateCreateInfo();
+		// creates a copy of the cache for use on a worker thread, its new contents can be merged back with merge
+		vk::UniquePipelineCache createWorkerCache();
+		void merge(const std::vector<vk::PipelineCache> &srcCaches);
+		// writes the cache to a temporary file first and then renames it, so the file on disk is never half written
+		bool save();
 
-	vk::PipelineColorBlendAttachmentState makeDefaultColorBlendSAttachmentState();
+	private:
+		bool isCompatible(const std::vector<std::uint8_t> &data) const;
 
-	struct Pipeline {
-		vk::UniquePipeline pipeline;
-		vk::UniquePipelineLayout layout;
+		vk::Device device;
+		std::uint32_t vendorID;
+		std::uint32_t deviceID;
+		std::array<std::uint8_t, VK_UUID_SIZE> pipelineCacheUUID;
+		std::filesystem::path filePath;
+		std::mutex mutex;
+		vk::UniquePipelineCache pipelineCache;
 	};
-	class GraphicsPipelineBuilder {
-	public:
-		GraphicsPipelineBuilder(vk::Device device, vk::RenderPass pass, vk::PipelineCache pipelineCache = nullptr);
-		Pipeline build();
 
-		GraphicsPipelineBuilder &setSubPass(uint32_t index);
-		GraphicsPipelineBuilder &setViewport(const vk::Viewport &viewport);
-		GraphicsPipelineBuilder &setScissor(const vk::Rect2D &scissor);
-		GraphicsPipelineBuilder &setVertexInput(const vk::PipelineVertexInputStateCreateInfo &vertexInput);
-		GraphicsPipelineBuilder &setInputAssembly(const vk::PipelineInputAssemblyStateCreateInfo &inputassembly);
-		GraphicsPipelineBuilder &setRasterization(const vk::PipelineRasterizationStateCreateInfo &rasterization);
-		GraphicsPipelineBuilder &setMultisampling(const vk::PipelineMultisampleStateCreateInfo &multisampling);
-		GraphicsPipelineBuilder &setDepthStencil(const vk::PipelineDepthStencilStateCreateInfo &depthStencil);
-		GraphicsPipelineBuilder &setColorBlend(const vk::PipelineColorBlendStateCreateInfo &colorBlend);
-		GraphicsPipelineBuilder &addColorBlendAttachemnt(const vk::PipelineColorBlendAttachmentState &colorAttachmentBlend);
-		GraphicsPipelineBuilder &addShaderStage(
-			const std::vector<uint32_t> *spv,
-			vk::ShaderStageFlagBits shaderStage,
-			vk::PipelineShaderStageCreateFlags flags = {},
-			vk::SpecializationInfo *pSpecializationInfo = {});
-		GraphicsPipelineBuilder &addDynamicState(const vk::DynamicState &dynamicstates);
-		GraphicsPipelineBuilder &addPushConstants(const vk::PushConstantRange &pushconstants);
-		GraphicsPipelineBuilder &setDescriptorLayouts(const std::vector<vk::DescriptorSetLayout> &layouts);
-#if defined(VULKANHELPER_USE_SPIRV_REFLECT)
+#if defined(VULKANHELPER_IMPLEMENTATION)
+	PipelineCacheStore::PipelineCacheStore(vk::Device device, vk::PhysicalDevice physicalDevice, std::filesystem::path filePath)
+		: device{device}, filePath{std::move(filePath)} {
+		auto properties = physicalDevice.getProperties();
+		vendorID = properties.vendorID;
+		deviceID = properties.deviceID;
+		std::copy(properties.pipelineCacheUUID.begin(), properties.pipelineCacheUUID.end(), pipelineCacheUUID.begin());
+
+		std::vector<std::uint8_t> data;
+		std::ifstream file{this->filePath, std::ios::ate | std::ios::binary};
+		if (file.is_open()) {
+			data.resize(static_cast<std::size_t>(file.tellg()));
+			file.seekg(0);
+			file.read(reinterpret_cast<char *>(data.data()), data.size());
+			file.close();
+		}
+
+		if (!data.empty() && !isCompatible(data)) {
+			std::cerr << "vulkan helper warning: pipeline cache " << this->filePath << " was created by another device or driver and is discarded!\n";
+			data.clear();
+		}
+
+		pipelineCache = device.createPipelineCacheUnique({
+			.initialDataSize = data.size(),
+			.pInitialData = data.data(),
+		});
+	}
+
+	PipelineCacheStore::~PipelineCacheStore() {
+		try {
+			save();
+		} catch (const std::exception &e) {
+			std::cerr << "vulkan helper warning: failed to save pipeline cache: " << e.what() << "\n";
+		}
+	}
+
+	vk::PipelineCache PipelineCacheStore::get() const {
+		return pipelineCache.get();
+	}
+
+	vk::PipelineCache PipelineCacheStore::operator*() const {
+		return get();
+	}
+
+	vk::UniquePipelineCache PipelineCacheStore::createWorkerCache() {
+		std::vector<std::uint8_t> data;
+		{
+			std::lock_guard lock{mutex};
+			data = device.getPipelineCacheData(*pipelineCache);
+		}
+		return device.createPipelineCacheUnique({
+			.initialDataSize = data.size(),
+			.pInitialData = data.data(),
+		});
+	}
+
+	void PipelineCacheStore::merge(const std::vector<vk::PipelineCache> &srcCaches) {
+		if (srcCaches.empty()) {
+			return;
+		}
+		std::lock_guard lock{mutex};
+		device.mergePipelineCaches(*pipelineCache, srcCaches);
+	}
+
+	bool PipelineCacheStore::save() {
+		std::vector<std::uint8_t> data;
+		{
+			std::lock_guard lock{mutex};
+			data = device.getPipelineCacheData(*pipelineCache);
+		}
+
+		if (filePath.has_parent_path()) {
+			std::filesystem::create_directories(filePath.parent_path());
+		}
+		auto tempPath = filePath;
+		tempPath += ".tmp";
+		{
+			std::ofstream file{tempPath, std::ios::binary | std::ios::trunc};
+			if (!file.is_open()) {
+				return false;
+			}
+			file.write(reinterpret_cast<const char *>(data.data()), data.size());
+			if (!file.good()) {
+				return false;
+			}
+		}
+		std::filesystem::rename(tempPath, filePath);
+		return true;
+	}
+
+	bool PipelineCacheStore::isCompatible(const std::vector<std::uint8_t> &data) const {
+		// layout of VkPipelineCacheHeaderVersionOne
+		struct Header {
+			std::uint32_t headerSize;
+			std::uint32_t headerVersion;
+			std::uint32_t vendorID;
+			std::uint32_t deviceID;
+			std::uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+		};
+		if (data.size() < sizeof(Header)) {
+			return false;
+		}
+		Header header;
+		std::memcpy(&header, data.data(), sizeof(Header));
+		return header.headerSize >= sizeof(Header) &&
+			   header.headerSize <= data.size() &&
+			   header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+			   header.vendorID == vendorID &&
+			   header.deviceID == deviceID &&
+			   std::memcmp(header.pipelineCacheUUID, pipelineCacheUUID.data(), VK_UUID_SIZE) == 0;
+	}
+#endif
+
+	// Hands out one shared shader module per unique spv, so pipelines sharing a shader also share its module.
+	// The cache keeps every module alive until trim() or its destruction. Thread safe.
+	// With useMaintenance5 no modules are created at all, the pipeline builders pass the spv to pipeline creation instead.
+	// It is opt-in, because the enabled features can't be queried from a device: the caller has to enable
+	// the maintenance5 feature and only pass the flag then. VK_EXT_shader_module_identifier is not used.
+	class ShaderModuleCache {
+	public:
+		ShaderModuleCache(vk::Device device, bool useMaintenance5 = false);
+		ShaderModuleCache(const ShaderModuleCache &) = delete;
+		ShaderModuleCache &operator=(const ShaderModuleCache &) = delete;
+
+		// returns nullptr when using maintenance5
+		std::shared_ptr<vk::UniqueShaderModule> get(std::span<const uint32_t> spv);
+		// destroys all modules that are not referenced outside of the cache anymore
+		void trim();
+		std::size_t size() const;
+		bool usesMaintenance5() const { return useMaintenance5; }
+
+		// 64 bit hash in the style of xxHash64, consuming 32 bytes per step in four independent lanes
+		static uint64_t hashSpirv(std::span<const uint32_t> spv);
+
+	private:
+		struct Entry {
+			std::vector<uint32_t> spv;
+			std::shared_ptr<vk::UniqueShaderModule> module;
+		};
+
+		vk::Device device;
+		bool useMaintenance5;
+		mutable std::mutex mutex;
+		std::unordered_multimap<uint64_t, Entry> entries;
+	};
+
+#if defined(VULKANHELPER_IMPLEMENTATION)
+	ShaderModuleCache::ShaderModuleCache(vk::Device device, bool useMaintenance5)
+		: device{device}, useMaintenance5{useMaintenance5} {
+#if !defined(VK_KHR_maintenance5)
+		if (useMaintenance5) {
+			std::cerr << "vulkan helper warning: the vulkan headers do not know VK_KHR_maintenance5, shader modules will be created\n";
+			this->useMaintenance5 = false;
+		}
+#endif
+	}
+
+	std::shared_ptr<vk::UniqueShaderModule> ShaderModuleCache::get(std::span<const uint32_t> spv) {
+		if (useMaintenance5) {
+			return nullptr;
+		}
+
+		const uint64_t hash = hashSpirv(spv);
+		std::lock_guard lock{mutex};
+		auto [begin, end] = entries.equal_range(hash);
+		for (auto iter = begin; iter != end; ++iter) {
+			if (std::equal(iter->second.spv.begin(), iter->second.spv.end(), spv.begin(), spv.end())) {
+				return iter->second.module;
+			}
+		}
+
+		auto module = std::make_shared<vk::UniqueShaderModule>(device.createShaderModuleUnique(vk::ShaderModuleCreateInfo{
+			.codeSize = spv.size_bytes(),
+			.pCode = spv.data(),
+		}));
+		entries.emplace(hash, Entry{
+								  .spv = std::vector<uint32_t>(spv.begin(), spv.end()),
+								  .module = module,
+							  });
+		return module;
+	}
+
+	void ShaderModuleCache::trim() {
+		std::lock_guard lock{mutex};
+		std::erase_if(entries, [](const auto &entry) {
+			return entry.second.module.use_count() == 1;
+		});
+	}
+
+	std::size_t ShaderModuleCache::size() const {
+		std::lock_guard lock{mutex};
+		return entries.size();
+	}
+
+	uint64_t ShaderModuleCache::hashSpirv(std::span<const uint32_t> spv) {
+		constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+		constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+		constexpr uint64_t PRIME3 = 0x165667B19E3779F9ull;
+		constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ull;
+		constexpr uint64_t PRIME5 = 0x27D4EB2F165667C5ull;
+		auto round = [](uint64_t accumulator, uint64_t input) {
+			return std::rotl(accumulator + input * PRIME2, 31) * PRIME1;
+		};
+		auto mergeRound = [&round](uint64_t accumulator, uint64_t lane) {
+			return (accumulator ^ round(0, lane)) * PRIME1 + PRIME4;
+		};
+		auto readWord64 = [](const uint32_t *words) {
+			uint64_t value;
+			std::memcpy(&value, words, sizeof(value));
+			return value;
+		};
+
+		const uint32_t *words = spv.data();
+		const uint32_t *wordsEnd = words + spv.size();
+		uint64_t hash;
+		if (spv.size() >= 8) {
+			// the lanes do not depend on each other, so the compiler is free to interleave or vectorize them
+			uint64_t lanes[4] = {PRIME1 + PRIME2, PRIME2, 0, 0 - PRIME1};
+			for (; wordsEnd - words >= 8; words += 8) {
+				for (int lane = 0; lane < 4; lane++) {
+					lanes[lane] = round(lanes[lane], readWord64(words + lane * 2));
+				}
+			}
+			hash = std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) + std::rotl(lanes[2], 12) + std::rotl(lanes[3], 18);
+			for (uint64_t lane : lanes) {
+				hash = mergeRound(hash, lane);
+			}
+		} else {
+			hash = PRIME5;
+		}
+		hash += spv.size_bytes();
+
+		for (; wordsEnd - words >= 2; words += 2) {
+			hash = std::rotl(hash ^ round(0, readWord64(words)), 27) * PRIME1 + PRIME4;
+		}
+		if (words != wordsEnd) {
+			hash = std::rotl(hash ^ (static_cast<uint64_t>(*words) * PRIME1), 23) * PRIME2 + PRIME3;
+		}
+
+		hash ^= hash >> 33;
+		hash *= PRIME2;
+		hash ^= hash >> 29;
+		hash *= PRIME3;
+		hash ^= hash >> 32;
+		return hash;
+	}
+#endif
+
+	// Creates one pipeline layout per distinct combination of descriptor set layouts and push constant ranges.
+	// Pipelines built with the same cache therefore have compatible layouts and can share bound descriptor sets.
+	class PipelineLayoutCache {
+	public:
+		PipelineLayoutCache(vk::Device device);
+		PipelineLayoutCache(const PipelineLayoutCache &) = delete;
+		PipelineLayoutCache &operator=(const PipelineLayoutCache &) = delete;
+
+		vk::PipelineLayout getLayout(std::span<const vk::DescriptorSetLayout> setLayouts, std::span<const vk::PushConstantRange> pushConstants);
+		// number of layouts created by the cache
+		std::size_t size() const;
+
+	private:
+		struct Entry {
+			std::vector<vk::DescriptorSetLayout> setLayouts;
+			std::vector<vk::PushConstantRange> pushConstants;
+			vk::UniquePipelineLayout layout;
+		};
+
+		static std::size_t hash(std::span<const vk::DescriptorSetLayout> setLayouts, std::span<const vk::PushConstantRange> pushConstants);
+
+		vk::Device device;
+		mutable std::mutex mutex;
+		std::unordered_multimap<std::size_t, Entry> entries;
+	};
+
+#if defined(VULKANHELPER_IMPLEMENTATION)
+	PipelineLayoutCache::PipelineLayoutCache(vk::Device device)
+		: device{device} {
+	}
+
+	vk::PipelineLayout PipelineLayoutCache::getLayout(std::span<const vk::DescriptorSetLayout> setLayouts, std::span<const vk::PushConstantRange> pushConstants) {
+		const std::size_t h = hash(setLayouts, pushConstants);
+		std::lock_guard lock{mutex};
+		auto [begin, end] = entries.equal_range(h);
+		for (auto iter = begin; iter != end; ++iter) {
+			if (std::ranges::equal(iter->second.setLayouts, setLayouts) && std::ranges::equal(iter->second.pushConstants, pushConstants)) {
+				return iter->second.layout.get();
+			}
+		}
+
+		vk::PipelineLayoutCreateInfo layoutCI{
+			.setLayoutCount = static_cast<uint32_t>(setLayouts.size()),
+			.pSetLayouts = setLayouts.data(),
+			.pushConstantRangeCount = static_cast<uint32_t>(pushConstants.size()),
+			.pPushConstantRanges = pushConstants.data(),
+		};
+		Entry entry;
+		entry.setLayouts.assign(setLayouts.begin(), setLayouts.end());
+		entry.pushConstants.assign(pushConstants.begin(), pushConstants.end());
+		entry.layout = device.createPipelineLayoutUnique(layoutCI);
+		return entries.emplace(h, std::move(entry))->second.layout.get();
+	}
+
+	std::size_t PipelineLayoutCache::size() const {
+		std::lock_guard lock{mutex};
+		return entries.size();
+	}
+
+	std::size_t PipelineLayoutCache::hash(std::span<const vk::DescriptorSetLayout> setLayouts, std::span<const vk::PushConstantRange> pushConstants) {
+		std::size_t h = setLayouts.size();
+		for (auto layout : setLayouts) {
+			h = hashCombine(h, std::hash<vk::DescriptorSetLayout>{}(layout));
+		}
+		for (const auto &range : pushConstants) {
+			h = hashCombine(h, static_cast<size_t>(static_cast<VkShaderStageFlags>(range.stageFlags)));
+			h = hashCombine(h, range.offset);
+			h = hashCombine(h, range.size);
+		}
+		return h;
+	}
+#endif
+
+	vk::PipelineRasterizationStateCreateInfo makeDefaultRasterisationStateCreateInfo(vk::PolygonMode polygonMode);
+
+	vk::PipelineMultisampleStateCreateInfo makeDefaultMultisampleStateCreateInfo();
+
+	vk::PipelineColorBlendAttachmentState makeDefaultColorBlendSAttachmentState();
+
+	struct Pipeline {
+		vk::UniquePipeline pipeline;
+		// empty when the layout is owned by a PipelineLayoutCache
+		vk::UniquePipelineLayout layout;
+		vk::PipelineLayout sharedLayout;
+
+		vk::PipelineLayout getLayout() const { return layout ? layout.get() : sharedLayout; }
+	};
+
+	// the state groups of VK_EXT_graphics_pipeline_library
+	enum class GraphicsPipelineStatePart {
+		eVertexInput,
+		ePreRasterization,
+		eFragmentShader,
+		eFragmentOutput,
+	};
+
+	class GraphicsPipelineBuilder {
+	public:
+		GraphicsPipelineBuilder(vk::Device device, vk::RenderPass pass, vk::PipelineCache pipelineCache = nullptr);
+		Pipeline build();
+		// Only succeeds if the pipeline can be created without compiling, e.g. because it is in the pipeline cache.
+		// Uses VK_EXT_pipeline_creation_cache_control, which has to be enabled on the device.
+		std::optional<Pipeline> tryBuild();
+		// Builds only the state of the part as a library of VK_EXT_graphics_pipeline_library,
+		// which has to be enabled on the device. Parts with equal state keys can be shared between pipelines.
+		Pipeline buildLibrary(GraphicsPipelineStatePart part);
+		// Links one library of every part into a pipeline with the state of this builder's layout.
+		// Without link time optimization this is fast enough to be done while recording.
+		Pipeline linkLibraries(std::span<const vk::Pipeline> libraries, bool linkTimeOptimization = false);
+
+		GraphicsPipelineBuilder &setSubPass(uint32_t index);
+		GraphicsPipelineBuilder &setViewport(const vk::Viewport &viewport);
+		GraphicsPipelineBuilder &setScissor(const vk::Rect2D &scissor);
+		GraphicsPipelineBuilder &setVertexInput(const vk::PipelineVertexInputStateCreateInfo &vertexInput);
+		GraphicsPipelineBuilder &setInputAssembly(const vk::PipelineInputAssemblyStateCreateInfo &inputassembly);
+		GraphicsPipelineBuilder &setRasterization(const vk::PipelineRasterizationStateCreateInfo &rasterization);
+		GraphicsPipelineBuilder &setMultisampling(const vk::PipelineMultisampleStateCreateInfo &multisampling);
+		GraphicsPipelineBuilder &setDepthStencil(const vk::PipelineDepthStencilStateCreateInfo &depthStencil);
+		GraphicsPipelineBuilder &setColorBlend(const vk::PipelineColorBlendStateCreateInfo &colorBlend);
+		GraphicsPipelineBuilder &addColorBlendAttachemnt(const vk::PipelineColorBlendAttachmentState &colorAttachmentBlend);
+		GraphicsPipelineBuilder &addShaderStage(
+			const std::vector<uint32_t> *spv,
+			vk::ShaderStageFlagBits shaderStage,
+			vk::PipelineShaderStageCreateFlags flags = {},
+			vk::SpecializationInfo *pSpecializationInfo = {});
+		GraphicsPipelineBuilder &addDynamicState(const vk::DynamicState &dynamicstates);
+		GraphicsPipelineBuilder &addPushConstants(const vk::PushConstantRange &pushconstants);
+		GraphicsPipelineBuilder &setDescriptorLayouts(const std::vector<vk::DescriptorSetLayout> &layouts);
+		GraphicsPipelineBuilder &setPipelineCache(vk::PipelineCache pipelineCache);
+		GraphicsPipelineBuilder &setCreateFlags(vk::PipelineCreateFlags createFlags);
+		// has to be set before adding shader stages, the spv has to outlive the builder when the cache uses maintenance5
+		GraphicsPipelineBuilder &setShaderModuleCache(ShaderModuleCache *moduleCache);
+		// equivalent pipelines built with the same cache share one pipeline layout
+		GraphicsPipelineBuilder &setPipelineLayoutCache(PipelineLayoutCache *pipelineLayoutCache);
 		GraphicsPipelineBuilder &reflectSPVForDescriptors(DescriptorSetLayoutCache &layoutCache);
 		GraphicsPipelineBuilder &reflectSPVForPushConstants();
-#endif // VULKANHELPER_USE_SPIRV_REFLECT
+
+		// Appends a canonical serialization of everything that affects the given part of the pipeline.
+		// State left unset and state explicitly set to the defaults of build() serialize the same.
+		// Shaders are identified by a hash of their spv, descriptor set layouts and the render pass by their handle.
+		void appendStateKey(GraphicsPipelineStatePart part, std::vector<uint32_t> &key) const;
+		// all parts of the pipeline
+		std::vector<uint32_t> makeStateKey() const;
 
 	private:
-#if defined(VULKANHELPER_USE_SPIRV_REFLECT)
+		// Returns nullopt if the flags contain eFailOnPipelineCompileRequiredEXT and a compile would be required.
+		// With a libraryPart only that part is built as a library, with libraries these get linked instead.
+		std::optional<Pipeline> build(vk::PipelineCreateFlags flags, std::optional<GraphicsPipelineStatePart> libraryPart = {}, std::span<const vk::Pipeline> libraries = {});
+
 		std::vector<std::pair<vk::ShaderStageFlagBits, const std::vector<uint32_t> *>> spvs;
-#endif // VULKANHELPER_USE_SPIRV_REFLECT
 		vk::Device device;
 		vk::RenderPass renderPass;
-		uint32_t subPass;
+		uint32_t subPass{0};
 		vk::PipelineCache pipelineCache;
+		vk::PipelineCreateFlags createFlags;
 		std::optional<vk::Viewport> viewport;
 		std::optional<vk::Rect2D> scissor;
 		std::optional<vk::PipelineVertexInputStateCreateInfo> vertexInput;
@@ -673,7 +2584,11 @@ namespace vkh {
 		std::vector<vk::PushConstantRange> pushConstants;
 		std::vector<vk::DescriptorSetLayout> descLayouts;
 
-		std::vector<vk::UniqueShaderModule> shaderModules;
+		ShaderModuleCache *moduleCache{nullptr};
+		PipelineLayoutCache *pipelineLayoutCache{nullptr};
+		std::vector<std::shared_ptr<vk::UniqueShaderModule>> shaderModules;
+		// chained into the stages without a module
+		std::vector<vk::ShaderModuleCreateInfo> shaderModuleCreateInfos;
 	};
 	class ComputePipelineBuilder {
 	public:
@@ -686,26 +2601,29 @@ namespace vkh {
 			vk::SpecializationInfo *pSpecializationInfo = {});
 		ComputePipelineBuilder &addPushConstants(const vk::PushConstantRange &pushconstants);
 		ComputePipelineBuilder &setDescriptorLayouts(const std::vector<vk::DescriptorSetLayout> &layouts);
-#if defined(VULKANHELPER_USE_SPIRV_REFLECT)
+		ComputePipelineBuilder &setPipelineCache(vk::PipelineCache pipelineCache);
+		// has to be set before setting the shader stage, the spv has to outlive the builder when the cache uses maintenance5
+		ComputePipelineBuilder &setShaderModuleCache(ShaderModuleCache *moduleCache);
+		// equivalent pipelines built with the same cache share one pipeline layout
+		ComputePipelineBuilder &setPipelineLayoutCache(PipelineLayoutCache *pipelineLayoutCache);
 		ComputePipelineBuilder &reflectSPVForDescriptors(DescriptorSetLayoutCache &layoutCache);
 		ComputePipelineBuilder &reflectSPVForPushConstants();
-#endif
 
 	private:
 		vk::Device device;
 		vk::PipelineCache pipelineCache;
-#if defined(VULKANHELPER_USE_SPIRV_REFLECT)
 		const std::vector<uint32_t> *spv;
-#endif
 		vk::PipelineShaderStageCreateInfo shaderStage;
 		std::vector<vk::PushConstantRange> pushConstants;
 		std::vector<vk::DescriptorSetLayout> descLayouts;
 
-		vk::UniqueShaderModule shaderModule;
+		ShaderModuleCache *moduleCache{nullptr};
+		PipelineLayoutCache *pipelineLayoutCache{nullptr};
+		std::shared_ptr<vk::UniqueShaderModule> shaderModule;
+		vk::ShaderModuleCreateInfo shaderModuleCreateInfo;
 	};
 
 #if defined(VULKANHELPER_IMPLEMENTATION)
-#if defined(VULKANHELPER_USE_SPIRV_REFLECT)
 	GraphicsPipelineBuilder &GraphicsPipelineBuilder::reflectSPVForDescriptors(DescriptorSetLayoutCache &layoutCache) {
 		std::vector<std::unordered_map<uint32_t, std::unordered_map<uint32_t, vk::DescriptorSetLayoutBinding>>> setMaps;
 
@@ -714,7 +2632,7 @@ namespace vkh {
 		}
 
 		for (auto [stage, spvPtr] : spvs) {
-			setMaps.push_back(reflectSetBindings(*spvPtr, stage));
+			setMaps.push_back(reflectShader(*spvPtr, stage).setBindings);
 		}
 		this->descLayouts = mergeReflectedSetBindings(setMaps, layoutCache);
 
@@ -728,12 +2646,11 @@ namespace vkh {
 		}
 		std::vector<std::vector<vk::PushConstantRange>> ranges;
 		for (auto [stage, spvPtr] : spvs) {
-			ranges.push_back(reflectPushConstants(*spvPtr, stage));
+			ranges.push_back(reflectShader(*spvPtr, stage).pushConstants);
 		}
 		this->pushConstants = mergeReflectedPushConstants(ranges);
 		return *this;
 	}
-#endif // VULKANHELPER_USE_SPIRV_REFLECT
 
 	GraphicsPipelineBuilder::GraphicsPipelineBuilder(vk::Device device, vk::RenderPass pass, vk::PipelineCache pipelineCache)
 		: device{device}, renderPass{pass}, pipelineCache{pipelineCache} {
@@ -786,14 +2703,19 @@ namespace vkh {
 		vk::ShaderModuleCreateInfo moduleCreateInfo{
 			.codeSize = static_cast<uint32_t>(spv->size()) * sizeof(uint32_t),
 			.pCode = spv->data()};
-#if defined(VULKANHELPER_USE_SPIRV_REFLECT)
 		this->spvs.emplace_back(shaderStage, spv);
-#endif // VULKANHELPER_USE_SPIRV_REFLECT
-		this->shaderModules.push_back(device.createShaderModuleUnique(moduleCreateInfo));
+		if (moduleCache) {
+			this->shaderModules.push_back(moduleCache->get(*spv));
+		} else {
+			this->shaderModules.push_back(std::make_shared<vk::UniqueShaderModule>(device.createShaderModuleUnique(moduleCreateInfo)));
+		}
+		this->shaderModuleCreateInfos.push_back(moduleCreateInfo);
 		vk::PipelineShaderStageCreateInfo pipelineStageCI{
+			.flags = flags,
 			.stage = shaderStage,
-			.module = this->shaderModules.back().get(),
-			.pName = "main"};
+			.module = this->shaderModules.back() ? this->shaderModules.back()->get() : vk::ShaderModule{},
+			.pName = "main",
+			.pSpecializationInfo = pSpecializationInfo};
 		this->shaderStages.push_back(pipelineStageCI);
 		return *this;
 	}
@@ -811,6 +2733,250 @@ namespace vkh {
 		return *this;
 	}
 
+	GraphicsPipelineBuilder &GraphicsPipelineBuilder::setPipelineCache(vk::PipelineCache pipelineCache) {
+		this->pipelineCache = pipelineCache;
+		return *this;
+	}
+
+	GraphicsPipelineBuilder &GraphicsPipelineBuilder::setCreateFlags(vk::PipelineCreateFlags createFlags) {
+		this->createFlags = createFlags;
+		return *this;
+	}
+
+	GraphicsPipelineBuilder &GraphicsPipelineBuilder::setShaderModuleCache(ShaderModuleCache *moduleCache) {
+		this->moduleCache = moduleCache;
+		return *this;
+	}
+
+	GraphicsPipelineBuilder &GraphicsPipelineBuilder::setPipelineLayoutCache(PipelineLayoutCache *pipelineLayoutCache) {
+		this->pipelineLayoutCache = pipelineLayoutCache;
+		return *this;
+	}
+
+	// writes values as 32 bit words, pointers are followed and never written themselves
+	class PipelineStateKeyWriter {
+	public:
+		explicit PipelineStateKeyWriter(std::vector<uint32_t> &key)
+			: key{key} {
+		}
+
+		void put(uint32_t value) { key.push_back(value); }
+		void put(float value) { key.push_back(std::bit_cast<uint32_t>(value)); }
+		void put64(uint64_t value) {
+			key.push_back(static_cast<uint32_t>(value));
+			key.push_back(static_cast<uint32_t>(value >> 32));
+		}
+		template <typename Enum>
+			requires std::is_enum_v<Enum>
+		void put(Enum value) {
+			put(static_cast<uint32_t>(value));
+		}
+		template <typename Bits>
+		void put(vk::Flags<Bits> flags) {
+			put(static_cast<uint32_t>(static_cast<typename vk::Flags<Bits>::MaskType>(flags)));
+		}
+		template <typename Handle>
+		void putHandle(Handle handle) {
+			put64(std::hash<Handle>{}(handle));
+		}
+		void putBytes(const void *data, std::size_t size) {
+			put(static_cast<uint32_t>(size));
+			const std::size_t offset = key.size();
+			key.resize(offset + (size + sizeof(uint32_t) - 1) / sizeof(uint32_t), 0);
+			if (size > 0) {
+				std::memcpy(key.data() + offset, data, size);
+			}
+		}
+		void putStencilOpState(const vk::StencilOpState &state) {
+			put(state.failOp);
+			put(state.passOp);
+			put(state.depthFailOp);
+			put(state.compareOp);
+			put(state.compareMask);
+			put(state.writeMask);
+			put(state.reference);
+		}
+
+	private:
+		std::vector<uint32_t> &key;
+	};
+
+	void GraphicsPipelineBuilder::appendStateKey(GraphicsPipelineStatePart part, std::vector<uint32_t> &key) const {
+		PipelineStateKeyWriter writer{key};
+		writer.put(part);
+		// flags like disable optimization or capture statistics change the created pipeline of every part
+		writer.put(createFlags);
+
+		auto putStages = [&](bool fragmentStage) {
+			for (std::size_t i = 0; i < shaderStages.size(); i++) {
+				const auto &stage = shaderStages[i];
+				if ((stage.stage == vk::ShaderStageFlagBits::eFragment) != fragmentStage) {
+					continue;
+				}
+				writer.put(stage.stage);
+				writer.put(stage.flags);
+				// hashed here instead of in addShaderStage, so only builders that make keys pay for it
+				writer.put64(ShaderModuleCache::hashSpirv(*spvs[i].second));
+				writer.putBytes(stage.pName, std::strlen(stage.pName));
+				if (const auto *specialization = stage.pSpecializationInfo) {
+					writer.put(specialization->mapEntryCount);
+					for (uint32_t entry = 0; entry < specialization->mapEntryCount; entry++) {
+						writer.put(specialization->pMapEntries[entry].constantID);
+						writer.put(specialization->pMapEntries[entry].offset);
+						writer.put64(specialization->pMapEntries[entry].size);
+					}
+					writer.putBytes(specialization->pData, specialization->dataSize);
+				} else {
+					writer.put(0u);
+				}
+			}
+		};
+		auto putLayout = [&]() {
+			writer.put(static_cast<uint32_t>(descLayouts.size()));
+			for (auto layout : descLayouts) {
+				writer.putHandle(layout);
+			}
+			writer.put(static_cast<uint32_t>(pushConstants.size()));
+			for (const auto &range : pushConstants) {
+				writer.put(range.stageFlags);
+				writer.put(range.offset);
+				writer.put(range.size);
+			}
+		};
+		auto putMultisampling = [&]() {
+			const auto multisample = multisampling.value_or(makeDefaultMultisampleStateCreateInfo());
+			writer.put(multisample.flags);
+			writer.put(multisample.rasterizationSamples);
+			writer.put(multisample.sampleShadingEnable);
+			writer.put(multisample.minSampleShading);
+			const uint32_t sampleMaskWords = multisample.pSampleMask ? (static_cast<uint32_t>(multisample.rasterizationSamples) + 31) / 32 : 0;
+			writer.put(sampleMaskWords);
+			for (uint32_t word = 0; word < sampleMaskWords; word++) {
+				writer.put(multisample.pSampleMask[word]);
+			}
+			writer.put(multisample.alphaToCoverageEnable);
+			writer.put(multisample.alphaToOneEnable);
+		};
+
+		// build() always adds viewport and scissor as dynamic state
+		std::vector<vk::DynamicState> dynamicStates = dynamicStateEnable;
+		dynamicStates.push_back(vk::DynamicState::eViewport);
+		dynamicStates.push_back(vk::DynamicState::eScissor);
+		std::sort(dynamicStates.begin(), dynamicStates.end());
+		dynamicStates.erase(std::unique(dynamicStates.begin(), dynamicStates.end()), dynamicStates.end());
+		writer.put(static_cast<uint32_t>(dynamicStates.size()));
+		for (auto dynamicState : dynamicStates) {
+			writer.put(dynamicState);
+		}
+
+		if (part != GraphicsPipelineStatePart::eVertexInput) {
+			writer.putHandle(renderPass);
+			writer.put(subPass);
+		}
+
+		switch (part) {
+		case GraphicsPipelineStatePart::eVertexInput: {
+			const auto input = vertexInput.value_or(vk::PipelineVertexInputStateCreateInfo{});
+			writer.put(input.flags);
+			writer.put(input.vertexBindingDescriptionCount);
+			for (uint32_t i = 0; i < input.vertexBindingDescriptionCount; i++) {
+				writer.put(input.pVertexBindingDescriptions[i].binding);
+				writer.put(input.pVertexBindingDescriptions[i].stride);
+				writer.put(input.pVertexBindingDescriptions[i].inputRate);
+			}
+			writer.put(input.vertexAttributeDescriptionCount);
+			for (uint32_t i = 0; i < input.vertexAttributeDescriptionCount; i++) {
+				writer.put(input.pVertexAttributeDescriptions[i].location);
+				writer.put(input.pVertexAttributeDescriptions[i].binding);
+				writer.put(input.pVertexAttributeDescriptions[i].format);
+				writer.put(input.pVertexAttributeDescriptions[i].offset);
+			}
+			const auto assembly = inputAssembly.value_or(vk::PipelineInputAssemblyStateCreateInfo{.topology = vk::PrimitiveTopology::eTriangleList});
+			writer.put(assembly.flags);
+			writer.put(assembly.topology);
+			writer.put(assembly.primitiveRestartEnable);
+			break;
+		}
+		case GraphicsPipelineStatePart::ePreRasterization: {
+			putStages(false);
+			putLayout();
+			const auto raster = rasterization.value_or(makeDefaultRasterisationStateCreateInfo(vk::PolygonMode::eFill));
+			writer.put(raster.flags);
+			writer.put(raster.depthClampEnable);
+			writer.put(raster.rasterizerDiscardEnable);
+			writer.put(raster.polygonMode);
+			writer.put(raster.cullMode);
+			writer.put(raster.frontFace);
+			writer.put(raster.depthBiasEnable);
+			writer.put(raster.depthBiasConstantFactor);
+			writer.put(raster.depthBiasClamp);
+			writer.put(raster.depthBiasSlopeFactor);
+			writer.put(raster.lineWidth);
+			break;
+		}
+		case GraphicsPipelineStatePart::eFragmentShader: {
+			putStages(true);
+			putLayout();
+			putMultisampling();
+			const auto depth = depthStencil.value_or(vk::PipelineDepthStencilStateCreateInfo{});
+			writer.put(depth.flags);
+			writer.put(depth.depthTestEnable);
+			writer.put(depth.depthWriteEnable);
+			writer.put(depth.depthCompareOp);
+			writer.put(depth.depthBoundsTestEnable);
+			writer.put(depth.stencilTestEnable);
+			writer.putStencilOpState(depth.front);
+			writer.putStencilOpState(depth.back);
+			writer.put(depth.minDepthBounds);
+			writer.put(depth.maxDepthBounds);
+			break;
+		}
+		case GraphicsPipelineStatePart::eFragmentOutput: {
+			putMultisampling();
+			// mirrors the color blend state selection of build()
+			vk::PipelineColorBlendStateCreateInfo blend{
+				.logicOpEnable = VK_FALSE,
+				.logicOp = vk::LogicOp::eCopy,
+			};
+			std::span<const vk::PipelineColorBlendAttachmentState> attachments = colorAttachmentBlends;
+			const auto defaultAttachment = makeDefaultColorBlendSAttachmentState();
+			if (colorBlend) {
+				blend = *colorBlend;
+				attachments = {colorBlend->pAttachments, colorBlend->attachmentCount};
+			} else if (attachments.empty()) {
+				attachments = {&defaultAttachment, 1};
+			}
+			writer.put(blend.flags);
+			writer.put(blend.logicOpEnable);
+			writer.put(blend.logicOp);
+			writer.put(static_cast<uint32_t>(attachments.size()));
+			for (const auto &attachment : attachments) {
+				writer.put(attachment.blendEnable);
+				writer.put(attachment.srcColorBlendFactor);
+				writer.put(attachment.dstColorBlendFactor);
+				writer.put(attachment.colorBlendOp);
+				writer.put(attachment.srcAlphaBlendFactor);
+				writer.put(attachment.dstAlphaBlendFactor);
+				writer.put(attachment.alphaBlendOp);
+				writer.put(attachment.colorWriteMask);
+			}
+			for (float constant : blend.blendConstants) {
+				writer.put(constant);
+			}
+			break;
+		}
+		}
+	}
+
+	std::vector<uint32_t> GraphicsPipelineBuilder::makeStateKey() const {
+		std::vector<uint32_t> key;
+		appendStateKey(GraphicsPipelineStatePart::eVertexInput, key);
+		appendStateKey(GraphicsPipelineStatePart::ePreRasterization, key);
+		appendStateKey(GraphicsPipelineStatePart::eFragmentShader, key);
+		appendStateKey(GraphicsPipelineStatePart::eFragmentOutput, key);
+		return key;
+	}
+
 	vk::PipelineRasterizationStateCreateInfo makeDefaultRasterisationStateCreateInfo(vk::PolygonMode polygonMode) {
 		return vk::PipelineRasterizationStateCreateInfo{
 			.polygonMode = polygonMode,
@@ -835,14 +3001,61 @@ namespace vkh {
 		};
 	}
 
+	static Pipeline requireCompiledPipeline(std::optional<Pipeline> pipeline) {
+		if (!pipeline) {
+			throw std::runtime_error("error: Failed to create graphics pipeline, a compile is required but eFailOnPipelineCompileRequiredEXT was set!");
+		}
+		return std::move(*pipeline);
+	}
+
+	static vk::GraphicsPipelineLibraryFlagsEXT toGraphicsPipelineLibraryFlags(GraphicsPipelineStatePart part) {
+		switch (part) {
+		case GraphicsPipelineStatePart::eVertexInput:
+			return vk::GraphicsPipelineLibraryFlagBitsEXT::eVertexInputInterface;
+		case GraphicsPipelineStatePart::ePreRasterization:
+			return vk::GraphicsPipelineLibraryFlagBitsEXT::ePreRasterizationShaders;
+		case GraphicsPipelineStatePart::eFragmentShader:
+			return vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentShader;
+		case GraphicsPipelineStatePart::eFragmentOutput:
+			return vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentOutputInterface;
+		}
+		return {};
+	}
+
 	Pipeline GraphicsPipelineBuilder::build() {
-		if (!vertexInput) {
+		return requireCompiledPipeline(build(createFlags));
+	}
+
+	std::optional<Pipeline> GraphicsPipelineBuilder::tryBuild() {
+		return build(createFlags | vk::PipelineCreateFlagBits::eFailOnPipelineCompileRequiredEXT);
+	}
+
+	Pipeline GraphicsPipelineBuilder::buildLibrary(GraphicsPipelineStatePart part) {
+		return requireCompiledPipeline(build(createFlags, part));
+	}
+
+	Pipeline GraphicsPipelineBuilder::linkLibraries(std::span<const vk::Pipeline> libraries, bool linkTimeOptimization) {
+		assert(libraries.size() == 4);
+		vk::PipelineCreateFlags flags = createFlags;
+		if (linkTimeOptimization) {
+			flags |= vk::PipelineCreateFlagBits::eLinkTimeOptimizationEXT;
+		}
+		return requireCompiledPipeline(build(flags, std::nullopt, libraries));
+	}
+
+	std::optional<Pipeline> GraphicsPipelineBuilder::build(vk::PipelineCreateFlags flags, std::optional<GraphicsPipelineStatePart> libraryPart, std::span<const vk::Pipeline> libraries) {
+		// a library only contains the state of its part, a linked pipeline takes all state from its libraries
+		auto hasPart = [&](GraphicsPipelineStatePart part) {
+			return libraries.empty() && (!libraryPart || *libraryPart == part);
+		};
+
+		if (!vertexInput && hasPart(GraphicsPipelineStatePart::eVertexInput)) {
 			std::cout << "error: vertexInput was not specified in pipeline builder!\n";
 			exit(-1);
 		}
 
 		// set state create infos:
-		vk::PipelineVertexInputStateCreateInfo pvertexInputCI = vertexInput.value();
+		vk::PipelineVertexInputStateCreateInfo pvertexInputCI = vertexInput.value_or(vk::PipelineVertexInputStateCreateInfo{});
 		vk::PipelineInputAssemblyStateCreateInfo pinputAssemlyStateCI = inputAssembly.value_or(vk::PipelineInputAssemblyStateCreateInfo{.topology = vk::PrimitiveTopology::eTriangleList});
 		vk::PipelineRasterizationStateCreateInfo prasterizationStateCI = rasterization.value_or(vkh::makeDefaultRasterisationStateCreateInfo(vk::PolygonMode::eFill));
 		vk::PipelineMultisampleStateCreateInfo multisamplerStateCI = multisampling.value_or(vkh::makeDefaultMultisampleStateCreateInfo());
@@ -852,15 +3065,20 @@ namespace vkh {
 
 		Pipeline pipeline;
 
-		//build pipeline layout:
-		vk::PipelineLayoutCreateInfo layoutCI{
-			.setLayoutCount = static_cast<uint32_t>(descLayouts.size()),
-			.pSetLayouts = descLayouts.data(),
-			.pushConstantRangeCount = uint32_t(pushConstants.size()),
-			.pPushConstantRanges = pushConstants.data(),
-		};
+		//build pipeline layout, vertex input and fragment output libraries don't have one:
+		const bool usesLayout = !libraries.empty() || hasPart(GraphicsPipelineStatePart::ePreRasterization) || hasPart(GraphicsPipelineStatePart::eFragmentShader);
+		if (usesLayout && pipelineLayoutCache) {
+			pipeline.sharedLayout = pipelineLayoutCache->getLayout(descLayouts, pushConstants);
+		} else if (usesLayout) {
+			vk::PipelineLayoutCreateInfo layoutCI{
+				.setLayoutCount = static_cast<uint32_t>(descLayouts.size()),
+				.pSetLayouts = descLayouts.data(),
+				.pushConstantRangeCount = uint32_t(pushConstants.size()),
+				.pPushConstantRanges = pushConstants.data(),
+			};
 
-		pipeline.layout = device.createPipelineLayoutUnique(layoutCI);
+			pipeline.layout = device.createPipelineLayoutUnique(layoutCI);
+		}
 
 		vk::PipelineViewportStateCreateInfo viewportStateCI{
 			.viewportCount = 1,
@@ -902,24 +3120,59 @@ namespace vkh {
 			.pDynamicStates = dynamicStateEnable.data(),
 		};
 
+		// stages without a module get their spv passed directly, as allowed by maintenance5
+		std::vector<vk::PipelineShaderStageCreateInfo> stages;
+		stages.reserve(shaderStages.size());
+		for (std::size_t i = 0; i < shaderStages.size(); i++) {
+			const bool fragmentStage = shaderStages[i].stage == vk::ShaderStageFlagBits::eFragment;
+			if (!hasPart(fragmentStage ? GraphicsPipelineStatePart::eFragmentShader : GraphicsPipelineStatePart::ePreRasterization)) {
+				continue;
+			}
+			stages.push_back(shaderStages[i]);
+			if (!stages.back().module) {
+				stages.back().pNext = &shaderModuleCreateInfos[i];
+			}
+		}
+
+		const bool hasVertexInput = hasPart(GraphicsPipelineStatePart::eVertexInput);
+		const bool hasPreRasterization = hasPart(GraphicsPipelineStatePart::ePreRasterization);
+		const bool hasFragmentShader = hasPart(GraphicsPipelineStatePart::eFragmentShader);
+		const bool hasFragmentOutput = hasPart(GraphicsPipelineStatePart::eFragmentOutput);
+
 		//we now use all of the info structs we have been writing into into this one to create the pipeline
 		vk::GraphicsPipelineCreateInfo pipelineCI{
-			.stageCount = (uint32_t)shaderStages.size(),
-			.pStages = shaderStages.data(),
-			.pVertexInputState = &pvertexInputCI,
-			.pInputAssemblyState = &pinputAssemlyStateCI,
-			.pViewportState = &viewportStateCI,
-			.pRasterizationState = &prasterizationStateCI,
-			.pMultisampleState = &multisamplerStateCI,
-			.pDepthStencilState = &pDepthStencilStateCI,
-			.pColorBlendState = &colorBlendingSCI,
-			.pDynamicState = &dynamicStateCI,
-			.layout = pipeline.layout.get(),
+			.flags = flags,
+			.stageCount = (uint32_t)stages.size(),
+			.pStages = stages.data(),
+			.pVertexInputState = hasVertexInput ? &pvertexInputCI : nullptr,
+			.pInputAssemblyState = hasVertexInput ? &pinputAssemlyStateCI : nullptr,
+			.pViewportState = hasPreRasterization ? &viewportStateCI : nullptr,
+			.pRasterizationState = hasPreRasterization ? &prasterizationStateCI : nullptr,
+			.pMultisampleState = hasFragmentShader || hasFragmentOutput ? &multisamplerStateCI : nullptr,
+			.pDepthStencilState = hasFragmentShader ? &pDepthStencilStateCI : nullptr,
+			.pColorBlendState = hasFragmentOutput ? &colorBlendingSCI : nullptr,
+			.pDynamicState = libraries.empty() ? &dynamicStateCI : nullptr,
+			.layout = pipeline.getLayout(),
 			.renderPass = renderPass,
 			.subpass = subPass,
 		};
 
+		vk::GraphicsPipelineLibraryCreateInfoEXT libraryCI{};
+		vk::PipelineLibraryCreateInfoKHR linkCI{};
+		if (libraryPart) {
+			libraryCI.flags = toGraphicsPipelineLibraryFlags(*libraryPart);
+			pipelineCI.pNext = &libraryCI;
+			pipelineCI.flags |= vk::PipelineCreateFlagBits::eLibraryKHR | vk::PipelineCreateFlagBits::eRetainLinkTimeOptimizationInfoEXT;
+		} else if (!libraries.empty()) {
+			linkCI.libraryCount = static_cast<uint32_t>(libraries.size());
+			linkCI.pLibraries = libraries.data();
+			pipelineCI.pNext = &linkCI;
+		}
+
 		auto ret = device.createGraphicsPipelineUnique(pipelineCache, pipelineCI);
+		if (ret.result == vk::Result::ePipelineCompileRequiredEXT) {
+			return std::nullopt;
+		}
 		if (ret.result != vk::Result::eSuccess) {
 			throw std::runtime_error("error: Failed to create graphics pipeline!");
 		}
@@ -935,17 +3188,21 @@ namespace vkh {
 		const std::vector<uint32_t> *spv,
 		vk::PipelineShaderStageCreateFlags flags,
 		vk::SpecializationInfo *pSpecializationInfo) {
-#if defined(VULKANHELPER_USE_SPIRV_REFLECT)
 		this->spv = spv;
-#endif
-		vk::ShaderModuleCreateInfo moduleCreateInfo{
+		this->shaderModuleCreateInfo = vk::ShaderModuleCreateInfo{
 			.codeSize = static_cast<uint32_t>(spv->size()) * sizeof(uint32_t),
 			.pCode = spv->data()};
-		this->shaderModule = device.createShaderModuleUnique(moduleCreateInfo);
+		if (moduleCache) {
+			this->shaderModule = moduleCache->get(*spv);
+		} else {
+			this->shaderModule = std::make_shared<vk::UniqueShaderModule>(device.createShaderModuleUnique(shaderModuleCreateInfo));
+		}
 		vk::PipelineShaderStageCreateInfo pipelineStageCI{
+			.flags = flags,
 			.stage = vk::ShaderStageFlagBits::eCompute,
-			.module = this->shaderModule.get(),
-			.pName = "main"};
+			.module = this->shaderModule ? this->shaderModule->get() : vk::ShaderModule{},
+			.pName = "main",
+			.pSpecializationInfo = pSpecializationInfo};
 		this->shaderStage = pipelineStageCI;
 		return *this;
 	}
@@ -959,19 +3216,30 @@ namespace vkh {
 		return *this;
 	}
 
-#if defined(VULKANHELPER_USE_SPIRV_REFLECT)
-	ComputePipelineBuilder &ComputePipelineBuilder::reflectSPVForDescriptors(DescriptorSetLayoutCache &layoutCache) {
-
+	ComputePipelineBuilder &ComputePipelineBuilder::setPipelineCache(vk::PipelineCache pipelineCache) {
+		this->pipelineCache = pipelineCache;
+		return *this;
+	}
+
+	ComputePipelineBuilder &ComputePipelineBuilder::setShaderModuleCache(ShaderModuleCache *moduleCache) {
+		this->moduleCache = moduleCache;
+		return *this;
+	}
+
+	ComputePipelineBuilder &ComputePipelineBuilder::setPipelineLayoutCache(PipelineLayoutCache *pipelineLayoutCache) {
+		this->pipelineLayoutCache = pipelineLayoutCache;
+		return *this;
+	}
+
+	ComputePipelineBuilder &ComputePipelineBuilder::reflectSPVForDescriptors(DescriptorSetLayoutCache &layoutCache) {
+
 		if (this->descLayouts.size() > 0) {
 			std::cerr << "vulkan helper warning: there are diescriptor set layouts set brefore reflectSPVForDescriptors. All descriptor set layouts will be replaced by reflectSPVForDescriptors!\n";
 		}
 
-		auto setMap = reflectSetBindings(*spv, vk::ShaderStageFlagBits::eCompute);
-		std::vector vec{setMap};
+		std::vector vec{reflectShader(*spv, vk::ShaderStageFlagBits::eCompute).setBindings};
 		this->descLayouts = mergeReflectedSetBindings(vec, layoutCache);
 
-		const std::vector<uint32_t> *vertexShaderSPV{nullptr};
-
 		return *this;
 	}
 	ComputePipelineBuilder &ComputePipelineBuilder::reflectSPVForPushConstants() {
@@ -979,28 +3247,37 @@ namespace vkh {
 		if (this->descLayouts.size() > 0) {
 			std::cerr << "vulkan helper warning: there are push constants ranges set before reflectSPV. All push constant ranges will be replaced by reflectSPVs!\n";
 		}
-		this->pushConstants = reflectPushConstants(*spv, vk::ShaderStageFlagBits::eCompute);
+		this->pushConstants = reflectShader(*spv, vk::ShaderStageFlagBits::eCompute).pushConstants;
 		return *this;
 	}
-#endif // #if defined(VULKANHELPER_USE_SPIRV_REFLECT)
 
 	Pipeline ComputePipelineBuilder::build() {
 		Pipeline pipeline;
 
 		//build pipeline layout:
-		vk::PipelineLayoutCreateInfo layoutCI{
-			.setLayoutCount = static_cast<uint32_t>(descLayouts.size()),
-			.pSetLayouts = descLayouts.data(),
-			.pushConstantRangeCount = uint32_t(pushConstants.size()),
-			.pPushConstantRanges = pushConstants.data(),
-		};
+		if (pipelineLayoutCache) {
+			pipeline.sharedLayout = pipelineLayoutCache->getLayout(descLayouts, pushConstants);
+		} else {
+			vk::PipelineLayoutCreateInfo layoutCI{
+				.setLayoutCount = static_cast<uint32_t>(descLayouts.size()),
+				.pSetLayouts = descLayouts.data(),
+				.pushConstantRangeCount = uint32_t(pushConstants.size()),
+				.pPushConstantRanges = pushConstants.data(),
+			};
 
-		pipeline.layout = device.createPipelineLayoutUnique(layoutCI);
+			pipeline.layout = device.createPipelineLayoutUnique(layoutCI);
+		}
+
+		vk::PipelineShaderStageCreateInfo stage = this->shaderStage;
+		if (!stage.module) {
+			// no module, so the spv gets passed directly, as allowed by maintenance5
+			stage.pNext = &shaderModuleCreateInfo;
+		}
 
 		//we now use all of the info structs we have been writing into into this one to create the pipeline
 		vk::ComputePipelineCreateInfo pipelineCI{
-			.stage = this->shaderStage,
-			.layout = pipeline.layout.get(),
+			.stage = stage,
+			.layout = pipeline.getLayout(),
 		};
 
 		auto ret = device.createComputePipelineUnique(pipelineCache, pipelineCI);
@@ -1013,31 +3290,670 @@ namespace vkh {
 	}
 #endif
 
+	// Compiles a batch of pipelines on multiple threads.
+	// When a PipelineCacheStore is given, every worker thread compiles against its own copy of the cache,
+	// which are all merged back into the store once compile() is done.
+	class PipelineBatchCompiler {
+	public:
+		PipelineBatchCompiler(vk::Device device, PipelineCacheStore *cacheStore = nullptr, std::uint32_t threadCount = std::thread::hardware_concurrency());
+
+		std::future<Pipeline> add(GraphicsPipelineBuilder builder);
+		std::future<Pipeline> add(ComputePipelineBuilder builder);
+		// compiles all pipelines added since the last call, blocks until all of them are finished
+		void compile();
+
+	private:
+		struct Job {
+			std::variant<GraphicsPipelineBuilder, ComputePipelineBuilder> builder;
+			std::promise<Pipeline> promise;
+		};
+
+		vk::Device device;
+		PipelineCacheStore *cacheStore;
+		std::uint32_t threadCount;
+		std::vector<Job> jobs;
+	};
+
+#if defined(VULKANHELPER_IMPLEMENTATION)
+	PipelineBatchCompiler::PipelineBatchCompiler(vk::Device device, PipelineCacheStore *cacheStore, std::uint32_t threadCount)
+		: device{device}, cacheStore{cacheStore}, threadCount{std::max(threadCount, 1u)} {
+	}
+
+	std::future<Pipeline> PipelineBatchCompiler::add(GraphicsPipelineBuilder builder) {
+		jobs.push_back(Job{.builder = std::move(builder)});
+		return jobs.back().promise.get_future();
+	}
+
+	std::future<Pipeline> PipelineBatchCompiler::add(ComputePipelineBuilder builder) {
+		jobs.push_back(Job{.builder = std::move(builder)});
+		return jobs.back().promise.get_future();
+	}
+
+	void PipelineBatchCompiler::compile() {
+		if (jobs.empty()) {
+			return;
+		}
+
+		const auto workerCount = static_cast<std::uint32_t>(std::min<std::size_t>(threadCount, jobs.size()));
+		std::vector<vk::UniquePipelineCache> workerCaches(workerCount);
+		if (cacheStore) {
+			for (auto &workerCache : workerCaches) {
+				workerCache = cacheStore->createWorkerCache();
+			}
+		}
+
+		std::atomic<std::size_t> nextJob{0};
+		auto work = [&](std::uint32_t workerIndex) {
+			vk::PipelineCache workerCache = workerCaches[workerIndex].get();
+			for (std::size_t jobIndex = nextJob++; jobIndex < jobs.size(); jobIndex = nextJob++) {
+				auto &job = jobs[jobIndex];
+				try {
+					job.promise.set_value(std::visit(
+						[&](auto &builder) {
+							if (workerCache) {
+								builder.setPipelineCache(workerCache);
+							}
+							return builder.build();
+						},
+						job.builder));
+				} catch (...) {
+					job.promise.set_exception(std::current_exception());
+				}
+			}
+		};
+
+		// joins on every path, destroying a joinable thread would call std::terminate
+		struct Workers {
+			std::vector<std::thread> threads;
+			~Workers() {
+				for (auto &thread : threads) {
+					thread.join();
+				}
+			}
+		};
+		{
+			Workers workers;
+			workers.threads.reserve(workerCount - 1);
+			for (std::uint32_t workerIndex = 1; workerIndex < workerCount; ++workerIndex) {
+				try {
+					workers.threads.emplace_back(work, workerIndex);
+				} catch (const std::system_error &) {
+					// the threads that did start and this one still take every job
+					break;
+				}
+			}
+			work(0);
+		}
+
+		if (cacheStore) {
+			std::vector<vk::PipelineCache> srcCaches;
+			srcCaches.reserve(workerCaches.size());
+			for (auto &workerCache : workerCaches) {
+				srcCaches.push_back(workerCache.get());
+			}
+			cacheStore->merge(srcCaches);
+		}
+		jobs.clear();
+	}
+#endif
+
+	struct PipelineStateKeyHash {
+		std::size_t operator()(const std::vector<uint32_t> &key) const { return ShaderModuleCache::hashSpirv(key); }
+	};
+
+	// Returns a shared pipeline for every builder whose state was seen before, instead of creating an identical one.
+	// The key is the canonical state of the builder, but it identifies shaders only by the 64 bit hash of their spv,
+	// so two different shaders with colliding hashes would share a pipeline. Thread safe.
+	class PipelineCacheMap {
+	public:
+		PipelineCacheMap() = default;
+		PipelineCacheMap(const PipelineCacheMap &) = delete;
+		PipelineCacheMap &operator=(const PipelineCacheMap &) = delete;
+
+		// builds the pipeline on a miss
+		std::shared_ptr<Pipeline> get(GraphicsPipelineBuilder &builder);
+		std::size_t size() const;
+		void clear();
+
+		uint64_t getHitCount() const { return hitCount.load(std::memory_order_relaxed); }
+		uint64_t getMissCount() const { return missCount.load(std::memory_order_relaxed); }
+		float getHitRate() const;
+
+	private:
+		mutable std::mutex mutex;
+		std::unordered_map<std::vector<uint32_t>, std::shared_ptr<Pipeline>, PipelineStateKeyHash> pipelines;
+		std::atomic<uint64_t> hitCount{0};
+		std::atomic<uint64_t> missCount{0};
+	};
+
+#if defined(VULKANHELPER_IMPLEMENTATION)
+	std::shared_ptr<Pipeline> PipelineCacheMap::get(GraphicsPipelineBuilder &builder) {
+		auto key = builder.makeStateKey();
+		{
+			std::lock_guard lock{mutex};
+			if (auto iter = pipelines.find(key); iter != pipelines.end()) {
+				hitCount.fetch_add(1, std::memory_order_relaxed);
+				return iter->second;
+			}
+		}
+
+		// build without holding the lock, if another thread was faster its pipeline is used instead
+		missCount.fetch_add(1, std::memory_order_relaxed);
+		auto pipeline = std::make_shared<Pipeline>(builder.build());
+		std::lock_guard lock{mutex};
+		return pipelines.try_emplace(std::move(key), std::move(pipeline)).first->second;
+	}
+	std::size_t PipelineCacheMap::size() const {
+		std::lock_guard lock{mutex};
+		return pipelines.size();
+	}
+	void PipelineCacheMap::clear() {
+		std::lock_guard lock{mutex};
+		pipelines.clear();
+	}
+	float PipelineCacheMap::getHitRate() const {
+		const uint64_t hits = getHitCount();
+		const uint64_t lookups = hits + getMissCount();
+		return lookups == 0 ? 0.0f : static_cast<float>(hits) / static_cast<float>(lookups);
+	}
+#endif
+
+	// Handle to a pipeline compiled by an AsyncPipelineCompiler.
+	// Resolves to the fallback pipeline until the compiled one is ready, bind it together with getLayout().
+	class AsyncPipeline {
+	public:
+		AsyncPipeline() = default;
+
+		bool isReady() const;
+		vk::Pipeline getPipeline() const;
+		vk::PipelineLayout getLayout() const;
+
+	private:
+		friend class AsyncPipelineCompiler;
+
+		struct State {
+			// set once pipeline is written, never reset
+			std::atomic<bool> ready{false};
+			Pipeline pipeline;
+			// only set when the fallback is owned by the handle
+			Pipeline ownedFallback;
+			vk::Pipeline fallback;
+			vk::PipelineLayout fallbackLayout;
+		};
+
+		std::shared_ptr<State> state;
+	};
+
+	// Compiles pipelines on a background thread, so new pipelines don't stall the render thread.
+	// compile() first tries to create the pipeline from the pipeline cache without compiling, only on a cache miss
+	// the compile is queued. Requires VK_EXT_pipeline_creation_cache_control.
+	class AsyncPipelineCompiler {
+	public:
+		explicit AsyncPipelineCompiler(vk::PipelineCache pipelineCache = nullptr);
+		AsyncPipelineCompiler(const AsyncPipelineCompiler &) = delete;
+		AsyncPipelineCompiler &operator=(const AsyncPipelineCompiler &) = delete;
+		// waits for the compile in progress, queued compiles are dropped and keep using their fallback
+		~AsyncPipelineCompiler();
+
+		// The fallback has to stay alive until the returned pipeline is ready,
+		// everything the builder references by pointer until the compile is done.
+		AsyncPipeline compile(GraphicsPipelineBuilder builder, const Pipeline &fallback);
+		// runs build on the background thread, the fallback is kept alive by the returned pipeline
+		AsyncPipeline compile(std::function<Pipeline()> build, Pipeline fallback);
+		// blocks until all queued compiles are done
+		void waitIdle();
+		std::size_t getPendingCount() const;
+
+	private:
+		struct Job {
+			std::shared_ptr<AsyncPipeline::State> state;
+			std::function<Pipeline()> build;
+		};
+
+		void enqueue(Job job);
+		void work();
+
+		vk::PipelineCache pipelineCache;
+		mutable std::mutex mutex;
+		std::condition_variable jobCondition;
+		std::condition_variable idleCondition;
+		std::deque<Job> jobs;
+		bool busy{false};
+		bool stop{false};
+		std::thread worker;
+	};
+
+#if defined(VULKANHELPER_IMPLEMENTATION)
+	bool AsyncPipeline::isReady() const {
+		assert(state);
+		return state->ready.load(std::memory_order_acquire);
+	}
+	vk::Pipeline AsyncPipeline::getPipeline() const {
+		return isReady() ? state->pipeline.pipeline.get() : state->fallback;
+	}
+	vk::PipelineLayout AsyncPipeline::getLayout() const {
+		return isReady() ? state->pipeline.getLayout() : state->fallbackLayout;
+	}
+
+	AsyncPipelineCompiler::AsyncPipelineCompiler(vk::PipelineCache pipelineCache)
+		: pipelineCache{pipelineCache} {
+		worker = std::thread{&AsyncPipelineCompiler::work, this};
+	}
+
+	AsyncPipelineCompiler::~AsyncPipelineCompiler() {
+		{
+			std::lock_guard lock{mutex};
+			stop = true;
+		}
+		jobCondition.notify_all();
+		worker.join();
+	}
+
+	AsyncPipeline AsyncPipelineCompiler::compile(GraphicsPipelineBuilder builder, const Pipeline &fallback) {
+		AsyncPipeline handle;
+		handle.state = std::make_shared<AsyncPipeline::State>();
+		handle.state->fallback = fallback.pipeline.get();
+		handle.state->fallbackLayout = fallback.getLayout();
+
+		if (pipelineCache) {
+			builder.setPipelineCache(pipelineCache);
+		}
+		if (auto pipeline = builder.tryBuild()) {
+			handle.state->pipeline = std::move(*pipeline);
+			handle.state->ready.store(true, std::memory_order_release);
+			return handle;
+		}
+
+		enqueue(Job{
+			.state = handle.state,
+			.build = [builder = std::move(builder)]() mutable { return builder.build(); },
+		});
+		return handle;
+	}
+
+	AsyncPipeline AsyncPipelineCompiler::compile(std::function<Pipeline()> build, Pipeline fallback) {
+		AsyncPipeline handle;
+		handle.state = std::make_shared<AsyncPipeline::State>();
+		handle.state->fallback = fallback.pipeline.get();
+		handle.state->fallbackLayout = fallback.getLayout();
+		handle.state->ownedFallback = std::move(fallback);
+		enqueue(Job{.state = handle.state, .build = std::move(build)});
+		return handle;
+	}
+
+	void AsyncPipelineCompiler::enqueue(Job job) {
+		{
+			std::lock_guard lock{mutex};
+			jobs.push_back(std::move(job));
+		}
+		jobCondition.notify_one();
+	}
+
+	void AsyncPipelineCompiler::waitIdle() {
+		std::unique_lock lock{mutex};
+		idleCondition.wait(lock, [&]() { return jobs.empty() && !busy; });
+	}
+
+	std::size_t AsyncPipelineCompiler::getPendingCount() const {
+		std::lock_guard lock{mutex};
+		return jobs.size() + (busy ? 1 : 0);
+	}
+
+	void AsyncPipelineCompiler::work() {
+		std::unique_lock lock{mutex};
+		while (true) {
+			jobCondition.wait(lock, [&]() { return stop || !jobs.empty(); });
+			if (stop) {
+				jobs.clear();
+				idleCondition.notify_all();
+				return;
+			}
+			Job job = std::move(jobs.front());
+			jobs.pop_front();
+			busy = true;
+			lock.unlock();
+
+			try {
+				job.state->pipeline = job.build();
+				job.state->ready.store(true, std::memory_order_release);
+			} catch (const std::exception &e) {
+				std::cerr << "vulkan helper warning: async pipeline compile failed, keeping the fallback pipeline: " << e.what() << "\n";
+			}
+
+			lock.lock();
+			busy = false;
+			if (jobs.empty()) {
+				idleCondition.notify_all();
+			}
+		}
+	}
+#endif
+
+	// Caches the four graphics pipeline library parts by their state key, so permutations that only differ in
+	// e.g. the fragment shader reuse the other three parts and only need a fast link.
+	// Requires VK_EXT_graphics_pipeline_library. Thread safe.
+	class PipelineLibraryCache {
+	public:
+		PipelineLibraryCache() = default;
+		PipelineLibraryCache(const PipelineLibraryCache &) = delete;
+		PipelineLibraryCache &operator=(const PipelineLibraryCache &) = delete;
+
+		// builds the library on a miss, it stays alive as long as the cache
+		vk::Pipeline getLibrary(GraphicsPipelineBuilder &builder, GraphicsPipelineStatePart part);
+		Pipeline link(GraphicsPipelineBuilder &builder, bool linkTimeOptimization = false);
+		// Fast links right away and compiles the link time optimized pipeline on the compiler's thread.
+		// The returned pipeline uses the fast linked one until then, the cache has to outlive the compile.
+		AsyncPipeline linkAsync(const GraphicsPipelineBuilder &builder, AsyncPipelineCompiler &compiler);
+		// number of cached libraries
+		std::size_t size() const;
+
+	private:
+		std::array<vk::Pipeline, 4> getLibraries(GraphicsPipelineBuilder &builder);
+
+		mutable std::mutex mutex;
+		std::unordered_map<std::vector<uint32_t>, Pipeline, PipelineStateKeyHash> libraries;
+	};
+
+#if defined(VULKANHELPER_IMPLEMENTATION)
+	vk::Pipeline PipelineLibraryCache::getLibrary(GraphicsPipelineBuilder &builder, GraphicsPipelineStatePart part) {
+		std::vector<uint32_t> key;
+		builder.appendStateKey(part, key);
+		{
+			std::lock_guard lock{mutex};
+			if (auto iter = libraries.find(key); iter != libraries.end()) {
+				return iter->second.pipeline.get();
+			}
+		}
+
+		// build without holding the lock, if another thread was faster its library is used instead
+		Pipeline library = builder.buildLibrary(part);
+		std::lock_guard lock{mutex};
+		return libraries.try_emplace(std::move(key), std::move(library)).first->second.pipeline.get();
+	}
+
+	std::array<vk::Pipeline, 4> PipelineLibraryCache::getLibraries(GraphicsPipelineBuilder &builder) {
+		return {
+			getLibrary(builder, GraphicsPipelineStatePart::eVertexInput),
+			getLibrary(builder, GraphicsPipelineStatePart::ePreRasterization),
+			getLibrary(builder, GraphicsPipelineStatePart::eFragmentShader),
+			getLibrary(builder, GraphicsPipelineStatePart::eFragmentOutput),
+		};
+	}
+
+	Pipeline PipelineLibraryCache::link(GraphicsPipelineBuilder &builder, bool linkTimeOptimization) {
+		const auto parts = getLibraries(builder);
+		return builder.linkLibraries(parts, linkTimeOptimization);
+	}
+
+	AsyncPipeline PipelineLibraryCache::linkAsync(const GraphicsPipelineBuilder &builder, AsyncPipelineCompiler &compiler) {
+		GraphicsPipelineBuilder linkBuilder = builder;
+		const auto parts = getLibraries(linkBuilder);
+		Pipeline fastLinked = linkBuilder.linkLibraries(parts);
+		return compiler.compile(
+			[linkBuilder, parts]() mutable { return linkBuilder.linkLibraries(parts, true); },
+			std::move(fastLinked));
+	}
+
+	std::size_t PipelineLibraryCache::size() const {
+		std::lock_guard lock{mutex};
+		return libraries.size();
+	}
+#endif
+
+	// Read only memory mapping of a whole file.
+	class MappedFile {
+	public:
+		MappedFile() = default;
+		MappedFile(const MappedFile &) = delete;
+		MappedFile &operator=(const MappedFile &) = delete;
+		MappedFile(MappedFile &&other) noexcept;
+		MappedFile &operator=(MappedFile &&other) noexcept;
+		~MappedFile();
+
+		static std::optional<MappedFile> open(const std::filesystem::path &filePath);
+
+		std::span<const std::byte> data() const { return {static_cast<const std::byte *>(view), size}; }
+
+	private:
+		void *mapping{nullptr};
+		const void *view{nullptr};
+		std::size_t size{0};
+	};
+
+	// Checks the SPIR-V magic number and word alignment and reinterprets the bytes as words without copying.
+	// The data has to be aligned to 4 bytes, which mapped files always are.
+	std::optional<std::span<const uint32_t>> asSpirvWords(std::span<const std::byte> data);
+
+	// Maps the file and creates the module straight from the mapping.
 	std::optional<vk::UniqueShaderModule> loadShaderModule(vk::Device device, std::filesystem::path filePath);
 
+	// Many shaders packed into one file, which is mapped once and indexed by shader name.
+	// Layout, all little endian uint32: magic, version, entry count, then per entry name offset, name length,
+	// data offset and data size in bytes, then the names and the 4 byte aligned spv data.
+	// Entries are sorted by name, so lookups are a binary search without any allocation.
+	class ShaderArchive {
+	public:
+		static std::optional<ShaderArchive> open(const std::filesystem::path &filePath);
+
+		// the words point into the mapping and stay valid as long as the archive lives
+		std::optional<std::span<const uint32_t>> find(std::string_view name) const;
+		std::optional<vk::UniqueShaderModule> loadShaderModule(vk::Device device, std::string_view name) const;
+		std::size_t size() const { return entries.size(); }
+
+		static constexpr uint32_t MAGIC = 0x41534b56; // "VKSA"
+		static constexpr uint32_t VERSION = 1;
+
+	private:
+		struct Entry {
+			uint32_t nameOffset;
+			uint32_t nameLength;
+			uint32_t dataOffset;
+			uint32_t dataSize;
+		};
+
+		std::string_view name(const Entry &entry) const;
+
+		MappedFile file;
+		std::span<const Entry> entries;
+	};
+
+	// Writes an archive readable by ShaderArchive, returns false if the file could not be written.
+	bool writeShaderArchive(const std::filesystem::path &filePath, const std::vector<std::pair<std::string, std::vector<uint32_t>>> &shaders);
+
 	vk::PipelineShaderStageCreateInfo makeShaderStageCreateInfo(vk::ShaderStageFlagBits stage, vk::ShaderModule shaderModule);
 
 #if defined(VULKANHELPER_IMPLEMENTATION)
+	MappedFile::MappedFile(MappedFile &&other) noexcept
+		: mapping{std::exchange(other.mapping, nullptr)}, view{std::exchange(other.view, nullptr)}, size{std::exchange(other.size, 0)} {
+	}
+	MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+		// the old mapping ends up in moved and gets released with it
+		MappedFile moved{std::move(other)};
+		std::swap(mapping, moved.mapping);
+		std::swap(view, moved.view);
+		std::swap(size, moved.size);
+		return *this;
+	}
+	MappedFile::~MappedFile() {
+		if (view) {
+			UnmapViewOfFile(view);
+		}
+		if (mapping) {
+			CloseHandle(mapping);
+		}
+		view = nullptr;
+		mapping = nullptr;
+	}
+
+	std::optional<MappedFile> MappedFile::open(const std::filesystem::path &filePath) {
+		HANDLE fileHandle = CreateFileW(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (fileHandle == INVALID_HANDLE_VALUE) {
+			return std::nullopt;
+		}
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(fileHandle, &fileSize)) {
+			CloseHandle(fileHandle);
+			return std::nullopt;
+		}
+
+		MappedFile mappedFile;
+		mappedFile.size = static_cast<std::size_t>(fileSize.QuadPart);
+		// empty files can not be mapped
+		if (mappedFile.size > 0) {
+			mappedFile.mapping = CreateFileMappingW(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		}
+		// the mapping keeps the file open on its own
+		CloseHandle(fileHandle);
+		if (mappedFile.size == 0) {
+			return mappedFile;
+		}
+		if (!mappedFile.mapping) {
+			return std::nullopt;
+		}
+		mappedFile.view = MapViewOfFile(mappedFile.mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!mappedFile.view) {
+			return std::nullopt;
+		}
+		return mappedFile;
+	}
+
+	std::optional<std::span<const uint32_t>> asSpirvWords(std::span<const std::byte> data) {
+		constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+		if (data.size() < sizeof(uint32_t) || data.size() % sizeof(uint32_t) != 0 ||
+			reinterpret_cast<std::uintptr_t>(data.data()) % alignof(uint32_t) != 0) {
+			return std::nullopt;
+		}
+		std::span<const uint32_t> words{reinterpret_cast<const uint32_t *>(data.data()), data.size() / sizeof(uint32_t)};
+		if (words[0] != SPIRV_MAGIC) {
+			return std::nullopt;
+		}
+		return words;
+	}
+
 	std::optional<vk::UniqueShaderModule> loadShaderModule(vk::Device device, std::filesystem::path filePath) {
-		std::ifstream file{filePath, std::ios::ate | std::ios::binary};
+		auto file = MappedFile::open(filePath);
+		if (!file) {
+			return {};
+		}
+		auto words = asSpirvWords(file->data());
+		if (!words) {
+			std::cerr << "error: " << filePath << " is not a valid SPIR-V file!\n";
+			return {};
+		}
+
+		return device.createShaderModuleUnique(vk::ShaderModuleCreateInfo{
+			.codeSize = words->size_bytes(),
+			.pCode = words->data(),
+		});
+	}
 
-		if (!file.is_open()) {
+	std::optional<ShaderArchive> ShaderArchive::open(const std::filesystem::path &filePath) {
+		auto file = MappedFile::open(filePath);
+		if (!file) {
+			return std::nullopt;
+		}
+		const auto data = file->data();
+		constexpr std::size_t HEADER_SIZE = 3 * sizeof(uint32_t);
+		if (data.size() < HEADER_SIZE) {
+			return std::nullopt;
+		}
+		uint32_t header[3];
+		std::memcpy(header, data.data(), HEADER_SIZE);
+		if (header[0] != MAGIC || header[1] != VERSION || (data.size() - HEADER_SIZE) / sizeof(Entry) < header[2]) {
+			std::cerr << "error: " << filePath << " is not a valid shader archive!\n";
+			return std::nullopt;
+		}
+
+		ShaderArchive archive;
+		archive.entries = {reinterpret_cast<const Entry *>(data.data() + HEADER_SIZE), header[2]};
+		for (const auto &entry : archive.entries) {
+			const bool inBounds =
+				static_cast<std::size_t>(entry.nameOffset) + entry.nameLength <= data.size() &&
+				static_cast<std::size_t>(entry.dataOffset) + entry.dataSize <= data.size();
+			if (!inBounds || entry.dataOffset % sizeof(uint32_t) != 0) {
+				std::cerr << "error: " << filePath << " contains an entry outside of the archive!\n";
+				return std::nullopt;
+			}
+		}
+		archive.file = std::move(*file);
+		return archive;
+	}
+
+	std::optional<std::span<const uint32_t>> ShaderArchive::find(std::string_view name) const {
+		auto iter = std::lower_bound(entries.begin(), entries.end(), name, [this](const Entry &entry, std::string_view name) {
+			return this->name(entry) < name;
+		});
+		if (iter == entries.end() || this->name(*iter) != name) {
+			return std::nullopt;
+		}
+		return asSpirvWords(file.data().subspan(iter->dataOffset, iter->dataSize));
+	}
+
+	std::optional<vk::UniqueShaderModule> ShaderArchive::loadShaderModule(vk::Device device, std::string_view name) const {
+		auto words = find(name);
+		if (!words) {
 			return {};
 		}
+		return device.createShaderModuleUnique(vk::ShaderModuleCreateInfo{
+			.codeSize = words->size_bytes(),
+			.pCode = words->data(),
+		});
+	}
 
-		size_t fileSize = static_cast<size_t>(file.tellg());
-		std::vector<uint32_t> buffer(fileSize / sizeof(uint32_t));
-		file.seekg(0);
-		file.read((char *)buffer.data(), fileSize);
-		file.close();
+	std::string_view ShaderArchive::name(const Entry &entry) const {
+		return {reinterpret_cast<const char *>(file.data().data()) + entry.nameOffset, entry.nameLength};
+	}
 
-		vk::ShaderModuleCreateInfo createInfo = {};
+	bool writeShaderArchive(const std::filesystem::path &filePath, const std::vector<std::pair<std::string, std::vector<uint32_t>>> &shaders) {
+		std::vector<const std::pair<std::string, std::vector<uint32_t>> *> sorted;
+		for (const auto &shader : shaders) {
+			sorted.push_back(&shader);
+		}
+		std::sort(sorted.begin(), sorted.end(), [](const auto *a, const auto *b) {
+			return a->first < b->first;
+		});
 
-		createInfo.codeSize = buffer.size() * sizeof(uint32_t);
-		createInfo.pCode = buffer.data();
+		std::vector<uint32_t> header{ShaderArchive::MAGIC, ShaderArchive::VERSION, static_cast<uint32_t>(sorted.size())};
+		std::string names;
+		std::size_t offset = (header.size() + sorted.size() * 4) * sizeof(uint32_t);
+		std::size_t namesSize = 0;
+		for (const auto *shader : sorted) {
+			namesSize += shader->first.size();
+		}
+		// the spv data starts at the first word boundary after the names
+		std::size_t dataOffset = (offset + namesSize + sizeof(uint32_t) - 1) / sizeof(uint32_t) * sizeof(uint32_t);
+		const std::size_t padding = dataOffset - offset - namesSize;
+		for (const auto *shader : sorted) {
+			header.push_back(static_cast<uint32_t>(offset + names.size()));
+			header.push_back(static_cast<uint32_t>(shader->first.size()));
+			header.push_back(static_cast<uint32_t>(dataOffset));
+			header.push_back(static_cast<uint32_t>(shader->second.size() * sizeof(uint32_t)));
+			names += shader->first;
+			dataOffset += shader->second.size() * sizeof(uint32_t);
+		}
+		names.append(padding, '\0');
 
-		vk::ShaderModule shaderModule;
-		return std::move(device.createShaderModuleUnique(createInfo));
+		if (filePath.has_parent_path()) {
+			std::filesystem::create_directories(filePath.parent_path());
+		}
+		auto tempPath = filePath;
+		tempPath += ".tmp";
+		{
+			std::ofstream file{tempPath, std::ios::binary | std::ios::trunc};
+			if (!file.is_open()) {
+				return false;
+			}
+			file.write(reinterpret_cast<const char *>(header.data()), header.size() * sizeof(uint32_t));
+			file.write(names.data(), names.size());
+			for (const auto *shader : sorted) {
+				file.write(reinterpret_cast<const char *>(shader->second.data()), shader->second.size() * sizeof(uint32_t));
+			}
+			if (!file.good()) {
+				return false;
+			}
+		}
+		std::filesystem::rename(tempPath, filePath);
+		return true;
 	}
 
 	vk::PipelineShaderStageCreateInfo makeShaderStageCreateInfo(vk::ShaderStageFlagBits stage, vk::ShaderModule shaderModule) {
@@ -1049,127 +3965,484 @@ namespace vkh {
 		return info;
 	}
 
-#endif
+#endif
+
+	vk::FenceCreateInfo makeDefaultFenceCI();
+
+	vk::AttachmentDescription makeDefaultColorAttackmentDescription();
+
+#if defined(VULKANHELPER_IMPLEMENTATION)
+	vk::FenceCreateInfo makeDefaultFenceCI() {
+		vk::FenceCreateInfo info{};
+		info.flags |= vk::FenceCreateFlagBits::eSignaled;
+		return info;
+	}
+
+	vk::AttachmentDescription makeDefaultColorAttackmentDescription() {
+		return vk::AttachmentDescription{
+			.format = vk::Format::eUndefined,
+			.samples = vk::SampleCountFlagBits::e1,
+			.loadOp = vk::AttachmentLoadOp::eClear,
+			.storeOp = vk::AttachmentStoreOp::eStore,
+			.stencilLoadOp = vk::AttachmentLoadOp::eDontCare,
+			.stencilStoreOp = vk::AttachmentStoreOp::eDontCare,
+			.initialLayout = vk::ImageLayout::eUndefined,
+			.finalLayout = vk::ImageLayout::ePresentSrcKHR,
+		};
+	}
+#endif
+
+	// Pool policy calling the given functions, the default policy of Pool.
+	template <typename T>
+	struct FunctionPoolPolicy {
+		std::function<T(void)> creator;
+		std::function<void(T)> destroyer;
+		std::function<void(T)> resetter;
+
+		T create() { return creator(); }
+		void reset(T el) { resetter(el); }
+		void destroy(T el) { destroyer(el); }
+	};
+
+	// Pool policy for fences, resetting all fences of a flush with a single resetFences call.
+	struct FencePoolPolicy {
+		vk::Device device;
+
+		vk::Fence create();
+		void reset(vk::Fence fence);
+		void resetBatch(std::span<const vk::Fence> fences);
+		void destroy(vk::Fence fence);
+	};
+
+#if defined(VULKANHELPER_IMPLEMENTATION)
+	vk::Fence FencePoolPolicy::create() {
+		return device.createFence(vk::FenceCreateInfo{});
+	}
+	void FencePoolPolicy::reset(vk::Fence fence) {
+		device.resetFences(fence);
+	}
+	void FencePoolPolicy::resetBatch(std::span<const vk::Fence> fences) {
+		device.resetFences(vk::ArrayProxy<const vk::Fence>{static_cast<uint32_t>(fences.size()), fences.data()});
+	}
+	void FencePoolPolicy::destroy(vk::Fence fence) {
+		device.destroyFence(fence);
+	}
+#endif
+
+	// Recycles objects, elements handed out by get() are reset and can be handed out again after flush().
+	// The policy provides T create(), void reset(T) and void destroy(T), which get inlined.
+	// It can optionally provide void createBatch(std::span<T>) and void resetBatch(std::span<const T>),
+	// which are then used instead to create or reset many elements with one call.
+	// A throwing createBatch has to destroy the elements it already created.
+	template <typename T, typename Policy = FunctionPoolPolicy<T>>
+	class Pool {
+	public:
+		Pool() = default;
+		explicit Pool(Policy policy) : policy{std::move(policy)} {}
+		Pool(std::function<T(void)> creator, std::function<void(T)> destroyer, std::function<void(T)> resetter)
+			requires std::is_same_v<Policy, FunctionPoolPolicy<T>>
+			: policy{std::move(creator), std::move(destroyer), std::move(resetter)} {}
+
+		Pool(const Pool &) = delete;
+		Pool &operator=(const Pool &) = delete;
+
+		Pool(Pool &&other)
+			: policy{std::move(other.policy)}, pool{std::exchange(other.pool, {})}, usedList{std::exchange(other.usedList, {})} {
+		}
+
+		Pool &operator=(Pool &&other) {
+			if (&other == this)
+				return *this;
+			destroyAll();
+			policy = std::move(other.policy);
+			pool = std::exchange(other.pool, {});
+			usedList = std::exchange(other.usedList, {});
+			return *this;
+		}
+
+		~Pool() {
+			destroyAll();
+		}
+
+		void flush() {
+			if constexpr (requires(Policy &p, std::span<const T> els) { p.resetBatch(els); }) {
+				if (!usedList.empty()) {
+					policy.resetBatch(std::span<const T>{usedList});
+				}
+			} else {
+				for (auto &el : usedList) {
+					policy.reset(el);
+				}
+			}
+			pool.insert(pool.end(), usedList.begin(), usedList.end());
+			usedList.clear();
+		}
+
+		T get() {
+			if (pool.size() == 0) {
+				if constexpr (requires(Policy &p, std::span<T> els) { p.createBatch(els); }) {
+					// grows geometrically with the number of elements in use, the pool only takes the elements
+					// once they are all created, so a throwing createBatch leaves no default constructed T behind
+					std::vector<T> created(usedList.size() > 4 ? usedList.size() : 4);
+					policy.createBatch(std::span<T>{created});
+					pool = std::move(created);
+				} else {
+					pool.push_back(policy.create());
+				}
+			}
+
+			auto el = pool.back();
+			pool.pop_back();
+			usedList.push_back(el);
+			return el;
+		}
+
+		Policy &getPolicy() { return policy; }
+
+	private:
+		void destroyAll() {
+			for (auto &el : pool) {
+				policy.destroy(el);
+			}
+			for (auto &el : usedList) {
+				policy.destroy(el);
+			}
+			pool.clear();
+			usedList.clear();
+		}
+
+		[[no_unique_address]] Policy policy;
+		std::vector<T> pool;
+		std::vector<T> usedList;
+	};
+
+	// Pool that can be used from many threads at once, for the same policies as Pool.
+	// Every thread gets and flushes through its own magazine of elements, which is refilled with whole blocks
+	// from a lock-free stack. When no block is available, the magazine is filled with create() or createBatch()
+	// on the calling thread without any lock; the mutex only guards growing the block storage and the first
+	// get() or flush() of a thread on a pool.
+	// Elements flushed in a frame are only reset and handed out again once advanceEpoch() reaches the frame
+	// framesInFlight frames later, when the gpu is done with them. create() and createBatch() have to be thread safe,
+	// a throwing createBatch has to destroy the elements it already created.
+	// Magazines are meant for long lived worker threads, the elements in the magazine of an exited thread stay unused.
+	template <typename T, typename Policy = FunctionPoolPolicy<T>>
+	class ConcurrentPool {
+	public:
+		ConcurrentPool(Policy policy, std::uint32_t framesInFlight, std::uint32_t magazineSize = 32)
+			: policy{std::move(policy)}, framesInFlight{framesInFlight}, magazineSize{magazineSize}, retired{std::make_unique<BlockStack[]>(framesInFlight)} {
+			assert(framesInFlight > 0 && magazineSize > 0);
+			availableBlocks.owner = this;
+			emptyBlocks.owner = this;
+			for (std::uint32_t i = 0; i < framesInFlight; ++i) {
+				retired[i].owner = this;
+			}
+		}
+		ConcurrentPool(const ConcurrentPool &) = delete;
+		ConcurrentPool &operator=(const ConcurrentPool &) = delete;
+
+		~ConcurrentPool() {
+			for (auto &magazine : magazines) {
+				destroy(magazine->available);
+				destroy(magazine->used);
+			}
+			const std::uint32_t blockCount = nextBlockIndex.load(std::memory_order_acquire);
+			for (std::uint32_t index = 1; index < blockCount; ++index) {
+				destroy(block(index).elements);
+			}
+		}
+
+		T get() {
+			Magazine &magazine = currentMagazine();
+			if (magazine.available.empty()) {
+				refill(magazine);
+			}
+			T el = magazine.available.back();
+			magazine.available.pop_back();
+			magazine.used.push_back(el);
+			return el;
+		}
+
+		// Retires the elements the calling thread got since its last flush with the current epoch.
+		void flush() {
+			Magazine &magazine = currentMagazine();
+			if (magazine.used.empty()) {
+				return;
+			}
+			std::uint32_t index = emptyBlocks.pop();
+			if (index == 0) {
+				index = allocateBlock();
+			}
+			std::swap(block(index).elements, magazine.used);
+			retired[epoch.load(std::memory_order_acquire) % framesInFlight].push(index);
+		}
+
+		// Has to be called once per frame by a single thread, after waiting for the frame framesInFlight frames old.
+		// Resets the elements retired in that frame and hands them out again.
+		void advanceEpoch() {
+			const std::uint64_t nextEpoch = epoch.load(std::memory_order_relaxed) + 1;
+			// recycle before publishing the epoch, so no element flushed in the new epoch gets recycled right away
+			std::uint32_t index = retired[nextEpoch % framesInFlight].popAll();
+			while (index != 0) {
+				Block &retiredBlock = block(index);
+				const std::uint32_t nextIndex = retiredBlock.next.load(std::memory_order_relaxed);
+				if constexpr (requires(Policy &p, std::span<const T> els) { p.resetBatch(els); }) {
+					policy.resetBatch(std::span<const T>{retiredBlock.elements});
+				} else {
+					for (auto &el : retiredBlock.elements) {
+						policy.reset(el);
+					}
+				}
+				availableBlocks.push(index);
+				index = nextIndex;
+			}
+			epoch.store(nextEpoch, std::memory_order_release);
+		}
+
+		std::uint64_t getEpoch() const { return epoch.load(std::memory_order_acquire); }
 
-	vk::FenceCreateInfo makeDefaultFenceCI();
+	private:
+		struct Block {
+			std::atomic<std::uint32_t> next{0};
+			std::vector<T> elements;
+		};
 
-	vk::AttachmentDescription makeDefaultColorAttackmentDescription();
+		// Treiber stack of block indices, 0 is the end of the stack.
+		// The head holds a tag in its upper half, which changes with every update to avoid ABA.
+		// Blocks are never freed before the pool, so a racing pop can always read next safely.
+		class BlockStack {
+		public:
+			void push(std::uint32_t index) {
+				std::uint64_t head = this->head.load(std::memory_order_relaxed);
+				do {
+					owner->block(index).next.store(static_cast<std::uint32_t>(head), std::memory_order_relaxed);
+				} while (!this->head.compare_exchange_weak(head, (head & ~indexMask) + tagIncrement + index, std::memory_order_release, std::memory_order_relaxed));
+			}
+			std::uint32_t pop() {
+				std::uint64_t head = this->head.load(std::memory_order_acquire);
+				while (true) {
+					const auto index = static_cast<std::uint32_t>(head);
+					if (index == 0) {
+						return 0;
+					}
+					const std::uint64_t next = (head & ~indexMask) + tagIncrement + owner->block(index).next.load(std::memory_order_relaxed);
+					if (this->head.compare_exchange_weak(head, next, std::memory_order_acquire, std::memory_order_acquire)) {
+						return index;
+					}
+				}
+			}
+			// takes the whole stack at once, the blocks stay linked through next
+			std::uint32_t popAll() {
+				std::uint64_t head = this->head.load(std::memory_order_acquire);
+				while (!this->head.compare_exchange_weak(head, (head & ~indexMask) + tagIncrement, std::memory_order_acquire, std::memory_order_acquire)) {
+				}
+				return static_cast<std::uint32_t>(head);
+			}
 
-#if defined(VULKANHELPER_IMPLEMENTATION)
-	vk::FenceCreateInfo makeDefaultFenceCI() {
-		vk::FenceCreateInfo info{};
-		info.flags |= vk::FenceCreateFlagBits::eSignaled;
-		return info;
-	}
+			ConcurrentPool *owner{nullptr};
 
-	vk::AttachmentDescription makeDefaultColorAttackmentDescription() {
-		return vk::AttachmentDescription{
-			.format = vk::Format::eUndefined,
-			.samples = vk::SampleCountFlagBits::e1,
-			.loadOp = vk::AttachmentLoadOp::eClear,
-			.storeOp = vk::AttachmentStoreOp::eStore,
-			.stencilLoadOp = vk::AttachmentLoadOp::eDontCare,
-			.stencilStoreOp = vk::AttachmentStoreOp::eDontCare,
-			.initialLayout = vk::ImageLayout::eUndefined,
-			.finalLayout = vk::ImageLayout::ePresentSrcKHR,
+		private:
+			static constexpr std::uint64_t indexMask = 0xffffffffull;
+			static constexpr std::uint64_t tagIncrement = 1ull << 32;
+			std::atomic<std::uint64_t> head{0};
 		};
-	}
-#endif
 
-	template <typename T>
-	class Pool {
-	public:
-		Pool() = default;
-		Pool(std::function<T(void)> creator, std::function<void(T)> destroyer, std::function<void(T)> resetter) : creator{std::move(creator)}, destroyer{std::move(destroyer)}, resetter{std::move(resetter)} {}
+		struct alignas(64) Magazine {
+			std::vector<T> available;
+			std::vector<T> used;
+		};
+
+		// block indices start at 1, chunk c holds the 64 << c blocks after the ones of the chunks before it
+		static constexpr std::uint32_t firstChunkSize = 64;
 
-		Pool(Pool &&other) {
-			this->creator = std::move(other.creator);
-			this->destroyer = std::move(other.destroyer);
-			this->resetter = std::move(other.resetter);
-			this->pool = std::move(other.pool);
-			this->usedList = std::move(other.usedList);
+		static std::uint32_t chunkOf(std::uint64_t position) {
+			return static_cast<std::uint32_t>(std::bit_width(position) - std::bit_width(std::uint64_t{firstChunkSize}));
 		}
 
-		Pool &operator=(Pool &&other) {
-			if (&other == this)
-				return *this;
-			return *new (this) Pool(std::move(other));
+		Block &block(std::uint32_t index) {
+			const std::uint64_t position = std::uint64_t{index} - 1 + firstChunkSize;
+			const std::uint32_t chunk = chunkOf(position);
+			return chunks[chunk].load(std::memory_order_acquire)[position - (std::uint64_t{firstChunkSize} << chunk)];
 		}
 
-		~Pool() {
-			for (auto &el : pool) {
-				destroyer(el);
-			}
-			for (auto &el : usedList) {
-				destroyer(el);
+		std::uint32_t allocateBlock() {
+			std::lock_guard lock{mutex};
+			const std::uint32_t index = nextBlockIndex.load(std::memory_order_relaxed);
+			const std::uint32_t chunk = chunkOf(std::uint64_t{index} - 1 + firstChunkSize);
+			if (!chunks[chunk].load(std::memory_order_relaxed)) {
+				ownedChunks.push_back(std::make_unique<Block[]>(std::size_t{firstChunkSize} << chunk));
+				chunks[chunk].store(ownedChunks.back().get(), std::memory_order_release);
 			}
-			pool.clear();
+			nextBlockIndex.store(index + 1, std::memory_order_release);
+			return index;
 		}
 
-		void flush() {
-			for (auto &el : usedList) {
-				resetter(el);
+		void refill(Magazine &magazine) {
+			if (const std::uint32_t index = availableBlocks.pop(); index != 0) {
+				std::swap(magazine.available, block(index).elements);
+				emptyBlocks.push(index);
+				return;
 			}
-			pool.insert(pool.end(), usedList.begin(), usedList.end());
-			usedList.clear();
+			// the magazine only takes the elements once all of them got created
+			std::vector<T> created;
+			if constexpr (requires(Policy &p, std::span<T> els) { p.createBatch(els); }) {
+				created.resize(magazineSize);
+				policy.createBatch(std::span<T>{created});
+			} else {
+				created.reserve(magazineSize);
+				try {
+					for (std::uint32_t i = 0; i < magazineSize; ++i) {
+						created.push_back(policy.create());
+					}
+				} catch (...) {
+					destroy(created);
+					throw;
+				}
+			}
+			magazine.available = std::move(created);
 		}
 
-		T get() {
-			if (pool.size() == 0) {
-				pool.push_back(creator());
+		struct ThreadMagazineEntry {
+			std::uint64_t poolId;
+			Magazine *magazine;
+			std::weak_ptr<const void> lifetime;
+		};
+
+		Magazine &currentMagazine() {
+			// pool ids are never reused, so entries of destroyed pools can't be mistaken for this one
+			static thread_local std::vector<ThreadMagazineEntry> threadMagazines;
+			for (const auto &entry : threadMagazines) {
+				if (entry.poolId == poolId) {
+					return *entry.magazine;
+				}
 			}
+			// drop the entries of destroyed pools, so the table only grows with the pools alive at once
+			std::erase_if(threadMagazines, [](const ThreadMagazineEntry &entry) { return entry.lifetime.expired(); });
+			std::lock_guard lock{mutex};
+			magazines.push_back(std::make_unique<Magazine>());
+			threadMagazines.push_back(ThreadMagazineEntry{.poolId = poolId, .magazine = magazines.back().get(), .lifetime = lifetime});
+			return *magazines.back();
+		}
 
-			auto el = pool.back();
-			pool.pop_back();
-			usedList.push_back(el);
-			return el;
+		void destroy(std::vector<T> &elements) {
+			for (auto &el : elements) {
+				policy.destroy(el);
+			}
+			elements.clear();
 		}
 
-	private:
-		std::function<T(void)> creator;
-		std::function<void(T)> destroyer;
-		std::function<void(T)> resetter;
-		std::vector<T> pool;
-		std::vector<T> usedList;
+		static inline std::atomic<std::uint64_t> nextPoolId{1};
+
+		const std::uint64_t poolId{nextPoolId.fetch_add(1, std::memory_order_relaxed)};
+		// expires with the pool, lets threads drop their magazine entries of destroyed pools
+		const std::shared_ptr<const void> lifetime{std::make_shared<char>()};
+		[[no_unique_address]] Policy policy;
+		const std::uint32_t framesInFlight;
+		const std::uint32_t magazineSize;
+		std::atomic<std::uint64_t> epoch{0};
+		BlockStack availableBlocks;
+		BlockStack emptyBlocks;
+		// indexed with epoch % framesInFlight
+		std::unique_ptr<BlockStack[]> retired;
+		std::array<std::atomic<Block *>, 26> chunks{};
+		std::atomic<std::uint32_t> nextBlockIndex{1};
+		std::mutex mutex;
+		std::vector<std::unique_ptr<Block[]>> ownedChunks;
+		std::vector<std::unique_ptr<Magazine>> magazines;
 	};
 
 	class CommandBufferAllocator {
 	public:
 		CommandBufferAllocator() = default;
-		CommandBufferAllocator(vk::Device device, const vk::CommandPoolCreateInfo &poolCI, const vk::CommandBufferLevel &bufferLevel = vk::CommandBufferLevel::ePrimary);
+		// prewarmCount buffers are allocated up front, so the first frames don't allocate while recording
+		CommandBufferAllocator(vk::Device device, const vk::CommandPoolCreateInfo &poolCI, const vk::CommandBufferLevel &bufferLevel = vk::CommandBufferLevel::ePrimary, uint32_t prewarmCount = 0);
 
 		void flush();
 
 		vk::CommandBuffer getElement();
+		// fills all of buffers, allocating missing buffers with a single call
+		void getElements(std::span<vk::CommandBuffer> buffers);
+		// Begins a secondary continuing the given subpass, the allocator has to allocate secondaries.
+		// The framebuffer is optional, but can help the driver.
+		vk::CommandBuffer beginSecondary(vk::RenderPass renderPass, uint32_t subpass, vk::Framebuffer framebuffer = {}, vk::CommandBufferUsageFlags flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+		vk::CommandBuffer beginSecondary(const vk::CommandBufferInheritanceInfo &inheritanceInfo, vk::CommandBufferUsageFlags flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
 
 		vk::CommandPool get();
 
 		vk::CommandPool operator*();
 
+		// number of buffers allocated from the pool, handed out or not
+		std::size_t capacity() const { return buffers.size(); }
+
 	private:
+		// grows geometrically to at least count buffers
+		void reserve(std::size_t count);
+
 		vk::Device device;
 		vk::UniqueCommandPool pool;
 		vk::CommandBufferLevel bufferLevel;
-		std::vector<vk::CommandBuffer> unused;
-		std::vector<vk::CommandBuffer> used;
+		// buffers[0, usedCount) were handed out since the last flush, the rest are ready to be handed out
+		std::vector<vk::CommandBuffer> buffers;
+		std::size_t usedCount{0};
 	};
 
 #if defined(VULKANHELPER_IMPLEMENTATION)
-	CommandBufferAllocator::CommandBufferAllocator(vk::Device device, const vk::CommandPoolCreateInfo &createInfo, const vk::CommandBufferLevel &bufferLevel) : device{device}, pool{device.createCommandPoolUnique(createInfo)}, bufferLevel{bufferLevel} {}
+	CommandBufferAllocator::CommandBufferAllocator(vk::Device device, const vk::CommandPoolCreateInfo &createInfo, const vk::CommandBufferLevel &bufferLevel, uint32_t prewarmCount) : device{device}, pool{device.createCommandPoolUnique(createInfo)}, bufferLevel{bufferLevel} {
+		reserve(prewarmCount);
+	}
 	void CommandBufferAllocator::flush() {
 		device.resetCommandPool(*pool);
-		unused.insert(unused.end(), used.begin(), used.end());
-		used.clear();
+		usedCount = 0;
 	}
 
 	vk::CommandBuffer CommandBufferAllocator::getElement() {
-		if (unused.empty()) {
-			unused.push_back(device.allocateCommandBuffers(vk::CommandBufferAllocateInfo{.commandPool = pool.get(), .level = bufferLevel, .commandBufferCount = 1}).back());
+		if (usedCount == buffers.size()) {
+			reserve(usedCount + 1);
+		}
+		return buffers[usedCount++];
+	}
+
+	void CommandBufferAllocator::getElements(std::span<vk::CommandBuffer> buffers) {
+		reserve(usedCount + buffers.size());
+		std::copy_n(this->buffers.begin() + usedCount, buffers.size(), buffers.begin());
+		usedCount += buffers.size();
+	}
+
+	vk::CommandBuffer CommandBufferAllocator::beginSecondary(vk::RenderPass renderPass, uint32_t subpass, vk::Framebuffer framebuffer, vk::CommandBufferUsageFlags flags) {
+		return beginSecondary(
+			vk::CommandBufferInheritanceInfo{
+				.renderPass = renderPass,
+				.subpass = subpass,
+				.framebuffer = framebuffer,
+			},
+			flags);
+	}
+
+	vk::CommandBuffer CommandBufferAllocator::beginSecondary(const vk::CommandBufferInheritanceInfo &inheritanceInfo, vk::CommandBufferUsageFlags flags) {
+		assert(bufferLevel == vk::CommandBufferLevel::eSecondary);
+		vk::CommandBuffer secondary = getElement();
+		secondary.begin(vk::CommandBufferBeginInfo{
+			.flags = flags | vk::CommandBufferUsageFlagBits::eRenderPassContinue,
+			.pInheritanceInfo = &inheritanceInfo,
+		});
+		return secondary;
+	}
+
+	void CommandBufferAllocator::reserve(std::size_t count) {
+		const std::size_t oldSize = buffers.size();
+		if (count <= oldSize) {
+			return;
+		}
+		const std::size_t newSize = std::max({count, oldSize * 2, std::size_t{8}});
+		buffers.resize(newSize);
+		vk::CommandBufferAllocateInfo allocInfo{
+			.commandPool = pool.get(),
+			.level = bufferLevel,
+			.commandBufferCount = static_cast<uint32_t>(newSize - oldSize),
+		};
+		if (device.allocateCommandBuffers(&allocInfo, buffers.data() + oldSize) != vk::Result::eSuccess) {
+			buffers.resize(oldSize);
+			throw std::runtime_error("error: Failed to allocate command buffers!");
 		}
-		auto buffer = unused.back();
-		unused.pop_back();
-		used.push_back(buffer);
-		return buffer;
 	}
 
 	vk::CommandPool CommandBufferAllocator::get() {
@@ -1180,6 +4453,348 @@ namespace vkh {
 		return get();
 	}
 
+#endif
+
+	// Keeps secondaries of static geometry recorded across frames, so they only get recorded again when
+	// the framebuffer, render pass or one of the pipelines they were recorded with changes.
+	// Replaced buffers are only reused once the frames in flight that might still execute them are done.
+	// Not thread safe.
+	class StaticCommandBufferCache {
+	public:
+		StaticCommandBufferCache(vk::Device device, uint32_t queueFamilyIndex, std::uint32_t framesInFlight);
+		StaticCommandBufferCache(const StaticCommandBufferCache &) = delete;
+		StaticCommandBufferCache &operator=(const StaticCommandBufferCache &) = delete;
+
+		// Has to be called once per frame, after waiting for the frame that is framesInFlight frames old.
+		void beginFrame();
+		// Returns the secondary cached for key if it was recorded with the same inheritance info and pipelines,
+		// otherwise record is called with a begun secondary, which gets ended afterwards.
+		vk::CommandBuffer get(uint64_t key, const vk::CommandBufferInheritanceInfo &inheritanceInfo, std::span<const vk::Pipeline> pipelines, const std::function<void(vk::CommandBuffer)> &record);
+		void invalidate(uint64_t key);
+		// invalidates all secondaries recorded for the framebuffer, e.g. before it gets destroyed on a resize
+		void invalidateFramebuffer(vk::Framebuffer framebuffer);
+		void invalidatePipeline(vk::Pipeline pipeline);
+		void clear();
+		// number of cached secondaries
+		std::size_t size() const { return entries.size(); }
+
+	private:
+		struct Entry {
+			vk::CommandBuffer buffer;
+			vk::RenderPass renderPass;
+			uint32_t subpass;
+			vk::Framebuffer framebuffer;
+			std::vector<vk::Pipeline> pipelines;
+		};
+
+		void retire(vk::CommandBuffer buffer);
+		vk::CommandBuffer acquire();
+
+		vk::Device device;
+		vk::UniqueCommandPool pool;
+		const std::uint32_t framesInFlight;
+		std::uint64_t frameNumber{0};
+		std::unordered_map<uint64_t, Entry> entries;
+		// buffers that might still be executed, with the frame number they were replaced in
+		std::deque<std::pair<std::uint64_t, vk::CommandBuffer>> retired;
+		std::vector<vk::CommandBuffer> available;
+	};
+
+#if defined(VULKANHELPER_IMPLEMENTATION)
+	StaticCommandBufferCache::StaticCommandBufferCache(vk::Device device, uint32_t queueFamilyIndex, std::uint32_t framesInFlight)
+		: device{device},
+		  pool{device.createCommandPoolUnique(vk::CommandPoolCreateInfo{.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer, .queueFamilyIndex = queueFamilyIndex})},
+		  framesInFlight{framesInFlight} {
+	}
+
+	void StaticCommandBufferCache::beginFrame() {
+		frameNumber++;
+		while (!retired.empty() && retired.front().first + framesInFlight <= frameNumber) {
+			available.push_back(retired.front().second);
+			retired.pop_front();
+		}
+	}
+
+	vk::CommandBuffer StaticCommandBufferCache::get(uint64_t key, const vk::CommandBufferInheritanceInfo &inheritanceInfo, std::span<const vk::Pipeline> pipelines, const std::function<void(vk::CommandBuffer)> &record) {
+		if (auto iter = entries.find(key); iter != entries.end()) {
+			const Entry &entry = iter->second;
+			if (entry.renderPass == inheritanceInfo.renderPass && entry.subpass == inheritanceInfo.subpass && entry.framebuffer == inheritanceInfo.framebuffer && std::ranges::equal(entry.pipelines, pipelines)) {
+				return entry.buffer;
+			}
+			retire(entry.buffer);
+			entries.erase(iter);
+		}
+
+		// the entry only gets added once the secondary is fully recorded, so a throwing record leaves no entry behind
+		vk::CommandBuffer buffer = acquire();
+		try {
+			// simultaneous use, as the frames in flight all execute the same secondary
+			buffer.begin(vk::CommandBufferBeginInfo{
+				.flags = vk::CommandBufferUsageFlagBits::eRenderPassContinue | vk::CommandBufferUsageFlagBits::eSimultaneousUse,
+				.pInheritanceInfo = &inheritanceInfo,
+			});
+			record(buffer);
+			buffer.end();
+			entries.emplace(key, Entry{
+									 .buffer = buffer,
+									 .renderPass = inheritanceInfo.renderPass,
+									 .subpass = inheritanceInfo.subpass,
+									 .framebuffer = inheritanceInfo.framebuffer,
+									 .pipelines = std::vector<vk::Pipeline>(pipelines.begin(), pipelines.end()),
+								 });
+		} catch (...) {
+			// the buffer was never submitted, but might still be recording, which begin does not allow
+			try {
+				buffer.reset();
+				available.push_back(buffer);
+			} catch (...) {
+				// the buffer stays allocated until the pool gets destroyed
+			}
+			throw;
+		}
+		return buffer;
+	}
+
+	void StaticCommandBufferCache::invalidate(uint64_t key) {
+		if (auto iter = entries.find(key); iter != entries.end()) {
+			retire(iter->second.buffer);
+			entries.erase(iter);
+		}
+	}
+
+	void StaticCommandBufferCache::invalidateFramebuffer(vk::Framebuffer framebuffer) {
+		std::erase_if(entries, [&](const auto &keyEntry) {
+			if (keyEntry.second.framebuffer != framebuffer) {
+				return false;
+			}
+			retire(keyEntry.second.buffer);
+			return true;
+		});
+	}
+
+	void StaticCommandBufferCache::invalidatePipeline(vk::Pipeline pipeline) {
+		std::erase_if(entries, [&](const auto &keyEntry) {
+			if (std::find(keyEntry.second.pipelines.begin(), keyEntry.second.pipelines.end(), pipeline) == keyEntry.second.pipelines.end()) {
+				return false;
+			}
+			retire(keyEntry.second.buffer);
+			return true;
+		});
+	}
+
+	void StaticCommandBufferCache::clear() {
+		for (const auto &[key, entry] : entries) {
+			retire(entry.buffer);
+		}
+		entries.clear();
+	}
+
+	void StaticCommandBufferCache::retire(vk::CommandBuffer buffer) {
+		retired.emplace_back(frameNumber, buffer);
+	}
+
+	vk::CommandBuffer StaticCommandBufferCache::acquire() {
+		if (available.empty()) {
+			// grow in batches, so static geometry showing up at once doesn't allocate one by one
+			available.resize(8);
+			vk::CommandBufferAllocateInfo allocInfo{
+				.commandPool = pool.get(),
+				.level = vk::CommandBufferLevel::eSecondary,
+				.commandBufferCount = static_cast<uint32_t>(available.size()),
+			};
+			if (device.allocateCommandBuffers(&allocInfo, available.data()) != vk::Result::eSuccess) {
+				available.clear();
+				throw std::runtime_error("error: Failed to allocate command buffers!");
+			}
+		}
+		vk::CommandBuffer buffer = available.back();
+		available.pop_back();
+		return buffer;
+	}
+#endif
+
+	// Keeps one primary and one secondary command buffer allocator per recording thread and frame in flight.
+	// Recording threads are told apart through a thread local lookup, so they don't need to pass an index,
+	// and every thread resets its pools of a frame on its first use in that frame.
+	// At most threadCount threads can be registered at the same time, threads that stop recording for good
+	// should call unregisterThread, so their index can be reused.
+	class ThreadedCommandContext {
+	public:
+		ThreadedCommandContext(vk::Device device, uint32_t queueFamilyIndex, std::uint32_t threadCount, std::uint32_t framesInFlight, uint32_t prewarmCount = 0);
+		ThreadedCommandContext(const ThreadedCommandContext &) = delete;
+		ThreadedCommandContext &operator=(const ThreadedCommandContext &) = delete;
+
+		// Has to be called before the threads start recording for the frame.
+		// If the fence of the frame is given, this waits for the gpu to be done with its command buffers.
+		void beginFrame(std::uint32_t frameIndex, vk::Fence frameFence = {});
+		vk::CommandBuffer getPrimary();
+		vk::CommandBuffer getSecondary();
+		// begins a one time submit secondary continuing the render pass of the inheritance info
+		vk::CommandBuffer beginSecondary(const vk::CommandBufferInheritanceInfo &inheritanceInfo);
+		// ends the secondary and queues it for executeSecondaries
+		void endSecondary(vk::CommandBuffer secondary);
+		// Executes the secondaries ended this frame, ordered by thread and then by the order they were ended.
+		// Has to be called after all recording threads are done.
+		void executeSecondaries(vk::CommandBuffer primary);
+		// index of the calling thread, assigned by registerThread on its first use of this context
+		std::uint32_t getThreadIndex();
+		// Assigns the calling thread a free index, unless it already has one.
+		// Throws if all threadCount indices are taken by registered threads.
+		std::uint32_t registerThread();
+		// Frees the index of the calling thread for other threads, e.g. for a restarted worker.
+		// Only call it once the thread is done recording, its command buffers stay in the slot of the index.
+		void unregisterThread();
+
+		const vk::Device device;
+
+	private:
+		struct ThreadIndexEntry {
+			std::uint64_t contextId;
+			std::uint32_t index;
+			std::weak_ptr<const void> lifetime;
+		};
+		// per thread lookup of the indices the thread got from all contexts
+		static std::vector<ThreadIndexEntry> &threadIndexEntries();
+
+		struct alignas(64) Slot {
+			Slot(vk::Device device, uint32_t queueFamilyIndex, uint32_t prewarmCount);
+			CommandBufferAllocator primary;
+			CommandBufferAllocator secondary;
+			std::vector<vk::CommandBuffer> endedSecondaries;
+			// number of the last frame that reset this slot
+			std::uint64_t frameNumber{0};
+		};
+
+		Slot &currentSlot();
+
+		const std::uint64_t contextId;
+		// expires with the context, so threads can drop their entries of destroyed contexts
+		const std::shared_ptr<const void> lifetime;
+		const std::uint32_t threadCount;
+		const std::uint32_t framesInFlight;
+		std::mutex threadIndexMutex;
+		std::vector<bool> usedThreadIndices;
+		std::atomic<std::uint32_t> frameIndex{0};
+		std::atomic<std::uint64_t> frameNumber{0};
+		// indexed with frameIndex * threadCount + threadIndex
+		std::vector<std::unique_ptr<Slot>> slots;
+		std::vector<vk::CommandBuffer> gatheredSecondaries;
+	};
+
+#if defined(VULKANHELPER_IMPLEMENTATION)
+	ThreadedCommandContext::Slot::Slot(vk::Device device, uint32_t queueFamilyIndex, uint32_t prewarmCount)
+		: primary{device, vk::CommandPoolCreateInfo{.flags = vk::CommandPoolCreateFlagBits::eTransient, .queueFamilyIndex = queueFamilyIndex}, vk::CommandBufferLevel::ePrimary, prewarmCount},
+		  secondary{device, vk::CommandPoolCreateInfo{.flags = vk::CommandPoolCreateFlagBits::eTransient, .queueFamilyIndex = queueFamilyIndex}, vk::CommandBufferLevel::eSecondary, prewarmCount} {
+	}
+	static std::uint64_t nextThreadedCommandContextId() {
+		static std::atomic<std::uint64_t> nextId{1};
+		return nextId.fetch_add(1, std::memory_order_relaxed);
+	}
+	ThreadedCommandContext::ThreadedCommandContext(vk::Device device, uint32_t queueFamilyIndex, std::uint32_t threadCount, std::uint32_t framesInFlight, uint32_t prewarmCount)
+		: device{device}, contextId{nextThreadedCommandContextId()}, lifetime{std::make_shared<char>()}, threadCount{threadCount}, framesInFlight{framesInFlight}, usedThreadIndices(threadCount, false) {
+		slots.reserve(threadCount * framesInFlight);
+		for (std::uint32_t i = 0; i < threadCount * framesInFlight; ++i) {
+			slots.push_back(std::make_unique<Slot>(device, queueFamilyIndex, prewarmCount));
+		}
+	}
+	void ThreadedCommandContext::beginFrame(std::uint32_t frameIndex, vk::Fence frameFence) {
+		assert(frameIndex < framesInFlight);
+		if (frameFence) {
+			while (device.waitForFences(frameFence, VK_TRUE, UINT64_MAX) == vk::Result::eTimeout) {
+			}
+		}
+		this->frameIndex.store(frameIndex, std::memory_order_relaxed);
+		this->frameNumber.fetch_add(1, std::memory_order_release);
+	}
+	vk::CommandBuffer ThreadedCommandContext::getPrimary() {
+		return currentSlot().primary.getElement();
+	}
+	vk::CommandBuffer ThreadedCommandContext::getSecondary() {
+		return currentSlot().secondary.getElement();
+	}
+	vk::CommandBuffer ThreadedCommandContext::beginSecondary(const vk::CommandBufferInheritanceInfo &inheritanceInfo) {
+		return currentSlot().secondary.beginSecondary(inheritanceInfo);
+	}
+	void ThreadedCommandContext::endSecondary(vk::CommandBuffer secondary) {
+		secondary.end();
+		currentSlot().endedSecondaries.push_back(secondary);
+	}
+	void ThreadedCommandContext::executeSecondaries(vk::CommandBuffer primary) {
+		const std::uint64_t currentFrameNumber = frameNumber.load(std::memory_order_acquire);
+		const std::uint32_t currentFrameIndex = frameIndex.load(std::memory_order_relaxed);
+		gatheredSecondaries.clear();
+		for (std::uint32_t threadIndex = 0; threadIndex < threadCount; ++threadIndex) {
+			const Slot &slot = *slots[currentFrameIndex * threadCount + threadIndex];
+			// slots not used this frame still hold the secondaries of their last frame
+			if (slot.frameNumber == currentFrameNumber) {
+				gatheredSecondaries.insert(gatheredSecondaries.end(), slot.endedSecondaries.begin(), slot.endedSecondaries.end());
+			}
+		}
+		if (!gatheredSecondaries.empty()) {
+			primary.executeCommands(gatheredSecondaries);
+		}
+	}
+	std::vector<ThreadedCommandContext::ThreadIndexEntry> &ThreadedCommandContext::threadIndexEntries() {
+		static thread_local std::vector<ThreadIndexEntry> entries;
+		return entries;
+	}
+	std::uint32_t ThreadedCommandContext::getThreadIndex() {
+		// context ids are never reused, so entries of destroyed contexts can't be mistaken for this one
+		for (const auto &entry : threadIndexEntries()) {
+			if (entry.contextId == contextId) {
+				return entry.index;
+			}
+		}
+		return registerThread();
+	}
+	std::uint32_t ThreadedCommandContext::registerThread() {
+		auto &entries = threadIndexEntries();
+		// only the contexts that are alive at the same time stay in the table
+		std::erase_if(entries, [](const ThreadIndexEntry &entry) { return entry.lifetime.expired(); });
+		for (const auto &entry : entries) {
+			if (entry.contextId == contextId) {
+				return entry.index;
+			}
+		}
+
+		std::uint32_t index;
+		{
+			std::lock_guard lock{threadIndexMutex};
+			auto unused = std::find(usedThreadIndices.begin(), usedThreadIndices.end(), false);
+			if (unused == usedThreadIndices.end()) {
+				throw std::runtime_error("error: more threads use the ThreadedCommandContext than it was created for, finished threads have to call unregisterThread!");
+			}
+			*unused = true;
+			index = static_cast<std::uint32_t>(std::distance(usedThreadIndices.begin(), unused));
+		}
+		entries.push_back(ThreadIndexEntry{.contextId = contextId, .index = index, .lifetime = lifetime});
+		return index;
+	}
+	void ThreadedCommandContext::unregisterThread() {
+		auto &entries = threadIndexEntries();
+		auto iter = std::find_if(entries.begin(), entries.end(), [&](const ThreadIndexEntry &entry) { return entry.contextId == contextId; });
+		if (iter == entries.end()) {
+			return;
+		}
+		{
+			std::lock_guard lock{threadIndexMutex};
+			usedThreadIndices[iter->index] = false;
+		}
+		entries.erase(iter);
+	}
+	ThreadedCommandContext::Slot &ThreadedCommandContext::currentSlot() {
+		const std::uint32_t threadIndex = getThreadIndex();
+		const std::uint64_t currentFrameNumber = frameNumber.load(std::memory_order_acquire);
+		Slot &slot = *slots[frameIndex.load(std::memory_order_relaxed) * threadCount + threadIndex];
+		if (slot.frameNumber != currentFrameNumber) {
+			// first use of this thread in the frame, the command buffers from the last use of the slot are retired
+			slot.primary.flush();
+			slot.secondary.flush();
+			slot.endedSecondaries.clear();
+			slot.frameNumber = currentFrameNumber;
+		}
+		return slot;
+	}
 #endif
 	class RenderPassBuilder {
 	public:
@@ -1314,7 +4929,9 @@ namespace vkh {
 
 	vk::PhysicalDevice selectPhysicalDevice(vk::Instance instance, const std::function<std::size_t(vk::PhysicalDevice)> &rateDeviceSuitability);
 
-	vk::Device createLogicalDevice(vk::PhysicalDevice physicalDevice, const std::set<std::size_t> &queueIndices, const std::vector<const char *> &extensions);
+	// enableDescriptorIndexing enables VK_EXT_descriptor_indexing with all its supported features, as needed by the BindlessDescriptorHeap.
+	// Throws if update after bind of sampled images, storage images or storage buffers is not supported.
+	vk::Device createLogicalDevice(vk::PhysicalDevice physicalDevice, const std::set<std::size_t> &queueIndices, const std::vector<const char *> &extensions, bool enableDescriptorIndexing = false);
 
 	std::uint32_t findMemoryTypeIndex(vk::PhysicalDeviceMemoryProperties const &memoryProperties, uint32_t typeBits, vk::MemoryPropertyFlags requirementsMask);
 
@@ -1396,7 +5013,7 @@ namespace vkh {
 		return devices[std::distance(devicesSuitability.begin(), bestDeviceIter)];
 	}
 
-	vk::Device createLogicalDevice(vk::PhysicalDevice physicalDevice, const std::set<std::size_t> &queueIndices, const std::vector<const char *> &extensions) {
+	vk::Device createLogicalDevice(vk::PhysicalDevice physicalDevice, const std::set<std::size_t> &queueIndices, const std::vector<const char *> &extensions, bool enableDescriptorIndexing) {
 		float queuePriority = 0.0f;
 		std::vector<vk::DeviceQueueCreateInfo> deviceQueueCreateinfos;
 		for (auto index : queueIndices) {
@@ -1406,11 +5023,41 @@ namespace vkh {
 				.pQueuePriorities = &queuePriority,
 			});
 		}
+
+		std::vector<const char *> enabledExtensions = extensions;
+		vk::PhysicalDeviceDescriptorIndexingFeatures descriptorIndexingFeatures;
+		if (enableDescriptorIndexing) {
+			auto features = physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceDescriptorIndexingFeatures>();
+			descriptorIndexingFeatures = features.get<vk::PhysicalDeviceDescriptorIndexingFeatures>();
+			descriptorIndexingFeatures.pNext = nullptr;
+			if (!descriptorIndexingFeatures.descriptorBindingPartiallyBound || !descriptorIndexingFeatures.runtimeDescriptorArray)
+				throw std::runtime_error("error: the physical device does not support the descriptor indexing features needed for bindless descriptors");
+			// the types of the default BindlessDescriptorHeap, uniform buffers are only enabled when supported
+			const std::pair<vk::Bool32, const char *> updateAfterBindFeatures[] = {
+				{descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind, "descriptorBindingSampledImageUpdateAfterBind"},
+				{descriptorIndexingFeatures.descriptorBindingStorageImageUpdateAfterBind, "descriptorBindingStorageImageUpdateAfterBind"},
+				{descriptorIndexingFeatures.descriptorBindingStorageBufferUpdateAfterBind, "descriptorBindingStorageBufferUpdateAfterBind"},
+			};
+			for (auto [supported, name] : updateAfterBindFeatures) {
+				if (!supported) {
+					throw std::runtime_error(std::string("error: the physical device does not support ") + name + ", which is needed for bindless descriptors");
+				}
+			}
+
+			const bool hasExtension = std::any_of(enabledExtensions.begin(), enabledExtensions.end(), [](const char *extension) {
+				return std::strcmp(extension, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) == 0;
+			});
+			if (!hasExtension) {
+				enabledExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+			}
+		}
+
 		return physicalDevice.createDevice({
+			.pNext = enableDescriptorIndexing ? &descriptorIndexingFeatures : nullptr,
 			.queueCreateInfoCount = static_cast<std::uint32_t>(deviceQueueCreateinfos.size()),
 			.pQueueCreateInfos = deviceQueueCreateinfos.data(),
-			.enabledExtensionCount = static_cast<uint32_t>(extensions.size()),
-			.ppEnabledExtensionNames = extensions.data(),
+			.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size()),
+			.ppEnabledExtensionNames = enabledExtensions.data(),
 		});
 	}
 
@@ -1428,4 +5075,221 @@ namespace vkh {
 		return type_index;
 	}
 #endif
+
+	struct MemoryAllocation {
+		vk::DeviceMemory memory;
+		vk::DeviceSize offset{0};
+		vk::DeviceSize size{0};
+		// only set for allocations in host visible memory, points directly to the start of the allocation
+		void *mappedData{nullptr};
+
+		// bookkeeping of the MemoryAllocator, do not modify:
+		std::uint32_t blockListIndex{0};
+		std::uint32_t blockIndex{0};
+		std::uint32_t level{0};
+	};
+
+	struct AllocatedBuffer {
+		vk::UniqueBuffer buffer;
+		MemoryAllocation allocation;
+	};
+
+	struct AllocatedImage {
+		vk::UniqueImage image;
+		MemoryAllocation allocation;
+	};
+
+	// Sub allocates big device memory blocks per memory type using buddy allocation.
+	// Requests that do not fit into a single block get their own dedicated device memory.
+	// Host visible blocks are persistently mapped, see MemoryAllocation::mappedData.
+	class MemoryAllocator {
+	public:
+		static constexpr std::uint32_t DEDICATED_BLOCK = std::uint32_t(~0);
+
+		MemoryAllocator(vk::Device device, vk::PhysicalDevice physicalDevice, vk::DeviceSize blockSize = vk::DeviceSize{64} << 20, vk::DeviceSize minAllocationSize = 256);
+		MemoryAllocator(const MemoryAllocator &) = delete;
+		MemoryAllocator &operator=(const MemoryAllocator &) = delete;
+		~MemoryAllocator();
+
+		MemoryAllocation allocate(const vk::MemoryRequirements &requirements, vk::MemoryPropertyFlags properties, bool linearResource = true);
+		void free(const MemoryAllocation &allocation);
+
+		AllocatedBuffer createBuffer(const vk::BufferCreateInfo &createInfo, vk::MemoryPropertyFlags properties);
+		AllocatedImage createImage(const vk::ImageCreateInfo &createInfo, vk::MemoryPropertyFlags properties);
+		void destroyBuffer(AllocatedBuffer &buffer);
+		void destroyImage(AllocatedImage &image);
+
+	private:
+		struct Block {
+			vk::DeviceMemory memory;
+			void *mappedData{nullptr};
+			// offsets of the free chunks for every buddy level, level 0 is the whole block
+			std::vector<std::set<vk::DeviceSize>> freeLists;
+		};
+
+		std::pair<vk::DeviceMemory, void *> allocateDeviceMemory(vk::DeviceSize size, std::uint32_t memoryTypeIndex);
+		std::optional<vk::DeviceSize> allocateFromBlock(Block &block, std::uint32_t level);
+
+		vk::Device device;
+		vk::PhysicalDeviceMemoryProperties memoryProperties;
+		vk::DeviceSize blockSize;
+		vk::DeviceSize minAllocationSize;
+		std::uint32_t levelCount;
+		// buddy chunks are aligned to their size, so linear and optimal resources can only share
+		// blocks when no chunk is smaller than the bufferImageGranularity
+		bool seperateLinearBlocks;
+		// indexed with memoryTypeIndex * 2 + (linear ? 0 : 1)
+		std::array<std::vector<Block>, VK_MAX_MEMORY_TYPES * 2> blockLists;
+	};
+
+#if defined(VULKANHELPER_IMPLEMENTATION)
+	MemoryAllocator::MemoryAllocator(vk::Device device, vk::PhysicalDevice physicalDevice, vk::DeviceSize blockSize, vk::DeviceSize minAllocationSize)
+		: device{device}, memoryProperties{physicalDevice.getMemoryProperties()}, blockSize{std::bit_ceil(blockSize)}, minAllocationSize{std::bit_ceil(minAllocationSize)} {
+		assert(this->minAllocationSize <= this->blockSize);
+		levelCount = static_cast<std::uint32_t>(std::countr_zero(this->blockSize) - std::countr_zero(this->minAllocationSize)) + 1;
+		seperateLinearBlocks = physicalDevice.getProperties().limits.bufferImageGranularity > this->minAllocationSize;
+	}
+
+	MemoryAllocator::~MemoryAllocator() {
+		for (auto &blocks : blockLists) {
+			for (auto &block : blocks) {
+				device.freeMemory(block.memory);
+			}
+		}
+	}
+
+	MemoryAllocation MemoryAllocator::allocate(const vk::MemoryRequirements &requirements, vk::MemoryPropertyFlags properties, bool linearResource) {
+		std::uint32_t memoryTypeIndex = findMemoryTypeIndex(memoryProperties, requirements.memoryTypeBits, properties);
+		// chunks are aligned to their size, so rounding the size up to the alignment also satisfies the alignment
+		vk::DeviceSize chunkSize = std::bit_ceil(std::max({requirements.size, requirements.alignment, minAllocationSize}));
+
+		MemoryAllocation allocation;
+		allocation.size = requirements.size;
+
+		if (chunkSize > blockSize) {
+			auto [memory, mappedData] = allocateDeviceMemory(requirements.size, memoryTypeIndex);
+			allocation.memory = memory;
+			allocation.mappedData = mappedData;
+			allocation.blockIndex = DEDICATED_BLOCK;
+			return allocation;
+		}
+
+		allocation.level = static_cast<std::uint32_t>(std::countr_zero(blockSize) - std::countr_zero(chunkSize));
+		allocation.blockListIndex = memoryTypeIndex * 2 + ((seperateLinearBlocks && !linearResource) ? 1 : 0);
+		auto &blocks = blockLists[allocation.blockListIndex];
+
+		auto fillAllocation = [&](std::uint32_t blockIndex, vk::DeviceSize offset) {
+			allocation.memory = blocks[blockIndex].memory;
+			allocation.offset = offset;
+			allocation.blockIndex = blockIndex;
+			if (blocks[blockIndex].mappedData) {
+				allocation.mappedData = static_cast<std::uint8_t *>(blocks[blockIndex].mappedData) + offset;
+			}
+			return allocation;
+		};
+
+		for (std::uint32_t blockIndex = 0; blockIndex < blocks.size(); ++blockIndex) {
+			if (auto offset = allocateFromBlock(blocks[blockIndex], allocation.level)) {
+				return fillAllocation(blockIndex, *offset);
+			}
+		}
+
+		// no block has a big enough free chunk left, so we need a new one
+		auto [memory, mappedData] = allocateDeviceMemory(blockSize, memoryTypeIndex);
+		blocks.push_back(Block{
+			.memory = memory,
+			.mappedData = mappedData,
+			.freeLists = std::vector<std::set<vk::DeviceSize>>(levelCount),
+		});
+		blocks.back().freeLists[0].insert(0);
+
+		auto blockIndex = static_cast<std::uint32_t>(blocks.size() - 1);
+		return fillAllocation(blockIndex, *allocateFromBlock(blocks.back(), allocation.level));
+	}
+
+	void MemoryAllocator::free(const MemoryAllocation &allocation) {
+		if (!allocation.memory) {
+			return;
+		}
+		if (allocation.blockIndex == DEDICATED_BLOCK) {
+			device.freeMemory(allocation.memory);
+			return;
+		}
+
+		auto &block = blockLists[allocation.blockListIndex][allocation.blockIndex];
+		vk::DeviceSize offset = allocation.offset;
+		std::uint32_t level = allocation.level;
+		// merge the chunk with its buddy for as long as the buddy is free as well
+		while (level > 0) {
+			vk::DeviceSize buddyOffset = offset ^ (blockSize >> level);
+			auto buddy = block.freeLists[level].find(buddyOffset);
+			if (buddy == block.freeLists[level].end()) {
+				break;
+			}
+			block.freeLists[level].erase(buddy);
+			offset = std::min(offset, buddyOffset);
+			level -= 1;
+		}
+		block.freeLists[level].insert(offset);
+	}
+
+	AllocatedBuffer MemoryAllocator::createBuffer(const vk::BufferCreateInfo &createInfo, vk::MemoryPropertyFlags properties) {
+		AllocatedBuffer result;
+		result.buffer = device.createBufferUnique(createInfo);
+		result.allocation = allocate(device.getBufferMemoryRequirements(*result.buffer), properties, true);
+		device.bindBufferMemory(*result.buffer, result.allocation.memory, result.allocation.offset);
+		return result;
+	}
+
+	AllocatedImage MemoryAllocator::createImage(const vk::ImageCreateInfo &createInfo, vk::MemoryPropertyFlags properties) {
+		AllocatedImage result;
+		result.image = device.createImageUnique(createInfo);
+		result.allocation = allocate(device.getImageMemoryRequirements(*result.image), properties, createInfo.tiling == vk::ImageTiling::eLinear);
+		device.bindImageMemory(*result.image, result.allocation.memory, result.allocation.offset);
+		return result;
+	}
+
+	void MemoryAllocator::destroyBuffer(AllocatedBuffer &buffer) {
+		buffer.buffer.reset();
+		free(buffer.allocation);
+		buffer.allocation = {};
+	}
+
+	void MemoryAllocator::destroyImage(AllocatedImage &image) {
+		image.image.reset();
+		free(image.allocation);
+		image.allocation = {};
+	}
+
+	std::pair<vk::DeviceMemory, void *> MemoryAllocator::allocateDeviceMemory(vk::DeviceSize size, std::uint32_t memoryTypeIndex) {
+		vk::DeviceMemory memory = device.allocateMemory({
+			.allocationSize = size,
+			.memoryTypeIndex = memoryTypeIndex,
+		});
+		void *mappedData = nullptr;
+		if (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible) {
+			mappedData = device.mapMemory(memory, 0, VK_WHOLE_SIZE);
+		}
+		return {memory, mappedData};
+	}
+
+	std::optional<vk::DeviceSize> MemoryAllocator::allocateFromBlock(Block &block, std::uint32_t level) {
+		// find the smallest free chunk that is big enough
+		std::int64_t freeLevel = level;
+		while (freeLevel >= 0 && block.freeLists[freeLevel].empty()) {
+			freeLevel -= 1;
+		}
+		if (freeLevel < 0) {
+			return {};
+		}
+
+		vk::DeviceSize offset = *block.freeLists[freeLevel].begin();
+		block.freeLists[freeLevel].erase(block.freeLists[freeLevel].begin());
+		// split it down to the requested level, keeping the lower halves and freeing the upper ones
+		for (std::int64_t splitLevel = freeLevel + 1; splitLevel <= level; ++splitLevel) {
+			block.freeLists[splitLevel].insert(offset + (blockSize >> splitLevel));
+		}
+		return offset;
+	}
+#endif
 } // namespace vkh
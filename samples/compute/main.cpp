@@ -38,21 +38,13 @@ int main() try {
 	localBuffer.resize(dim.x * dim.y);
 	std::uint32_t localBufferByteCount = static_cast<std::uint32_t>(localBuffer.size() * sizeof(localBuffer[0]));
 
-	auto deviceBuffer = logicalDevice.createBuffer({.size = localBufferByteCount, .usage = vk::BufferUsageFlagBits::eStorageBuffer});
-	auto deviceBufferMemoryRequirements = logicalDevice.getBufferMemoryRequirements(deviceBuffer);
-	auto deviceBufferMemoryTypeIndex = vkh::findMemoryTypeIndex(
-		selectedPhysicalDevice.getMemoryProperties(),
-		deviceBufferMemoryRequirements.memoryTypeBits,
+	vkh::MemoryAllocator memoryAllocator{logicalDevice, selectedPhysicalDevice};
+	auto deviceBuffer = memoryAllocator.createBuffer(
+		{.size = localBufferByteCount, .usage = vk::BufferUsageFlagBits::eStorageBuffer},
 		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-	auto deviceBufferMemory = logicalDevice.allocateMemory({
-		.allocationSize = deviceBufferMemoryRequirements.size,
-		.memoryTypeIndex = deviceBufferMemoryTypeIndex,
-	});
-	logicalDevice.bindBufferMemory(deviceBuffer, deviceBufferMemory, 0);
 
-	glslang::InitializeProcess();
-	auto computeSpv = loadGlslShaderToSpv("samples/compute/main.comp");
-	glslang::FinalizeProcess();
+	ShaderCompiler shaderCompiler{"shader-cache"};
+	auto computeSpv = shaderCompiler.compileFile("samples/compute/main.comp");
 
 	vkh::DescriptorSetLayoutCache layoutCache{ logicalDevice };
 	vkh::GeneralDescriptorSetAllocator descSetAllocator{ logicalDevice };
@@ -66,7 +58,7 @@ int main() try {
 					.descriptorCount = 1, 
 					.stageFlags = vk::ShaderStageFlagBits::eCompute
 			},
-			vk::DescriptorBufferInfo{.buffer = deviceBuffer, .range= localBufferByteCount}
+			vk::DescriptorBufferInfo{.buffer = *deviceBuffer.buffer, .range= localBufferByteCount}
 		)
 		.build();
 
@@ -104,9 +96,7 @@ int main() try {
 
 	logicalDevice.freeCommandBuffers(*commandPool, commandBuffer);
 
-	auto vertexbufferDeviceDataPtr = static_cast<std::uint8_t *>(logicalDevice.mapMemory(deviceBufferMemory, 0, deviceBufferMemoryRequirements.size));
-	std::memcpy(localBuffer.data(), vertexbufferDeviceDataPtr, localBufferByteCount);
-	logicalDevice.unmapMemory(deviceBufferMemory);
+	std::memcpy(localBuffer.data(), deviceBuffer.allocation.mappedData, localBufferByteCount);
 
 	auto savePPM = [](const std::filesystem::path &filepath, const std::vector<std::uint32_t> buffer, glm::ivec2 dim) {
 		std::ofstream output_file(filepath, std::ios::binary);
@@ -166,10 +166,10 @@ vk::RenderPass createRenderpass(vk::Device logicalDevice, vk::Format swapchainFo
 }
 
 std::pair<vk::Pipeline, vk::PipelineLayout> createGraphicsPipeline(vk::Device logical_device, vk::RenderPass renderpass, std::size_t vertexSize) {
-	glslang::InitializeProcess();
-	auto vert_spv = loadGlslShaderToSpv("samples/shared/hello-triangle/main.vert");
-	auto frag_spv = loadGlslShaderToSpv("samples/shared/hello-triangle/main.frag");
-	glslang::FinalizeProcess();
+	ShaderCompiler shaderCompiler{"shader-cache"};
+	auto spvs = shaderCompiler.compileFiles({"samples/shared/hello-triangle/main.vert", "samples/shared/hello-triangle/main.frag"});
+	auto &vert_spv = spvs[0];
+	auto &frag_spv = spvs[1];
 	vkh::VertexDiscriptionBuilder vertBuilder;
 	auto vertDesc = vertBuilder
 						.beginBinding((std::uint32_t)vertexSize)
@@ -214,8 +214,8 @@ struct HelloTriangle {
 	vk::Device logicalDevice;
 	vk::Queue graphicsQueue, presentQueue;
 
-	vk::Buffer vertexbuffer;
-	vk::DeviceMemory vertexbufferMemory;
+	std::optional<vkh::MemoryAllocator> memoryAllocator;
+	vkh::AllocatedBuffer vertexbuffer;
 
 	vk::SwapchainKHR swapchain;
 	SwapchainDetails swapchainDetails;
@@ -306,20 +306,11 @@ struct HelloTriangle {
 	}
 
 	void initVertexbuffer() {
-		vertexbuffer = logicalDevice.createBuffer({.size = sizeof(vertexData), .usage = vk::BufferUsageFlagBits::eVertexBuffer});
-		auto vertexbufferMemoryRequirements = logicalDevice.getBufferMemoryRequirements(vertexbuffer);
-		auto vertexbufferMemoryTypeIndex = vkh::findMemoryTypeIndex(
-			selectedPhysicalDevice.getMemoryProperties(),
-			vertexbufferMemoryRequirements.memoryTypeBits,
+		memoryAllocator.emplace(logicalDevice, selectedPhysicalDevice);
+		vertexbuffer = memoryAllocator->createBuffer(
+			{.size = sizeof(vertexData), .usage = vk::BufferUsageFlagBits::eVertexBuffer},
 			vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-		vertexbufferMemory = logicalDevice.allocateMemory({
-			.allocationSize = vertexbufferMemoryRequirements.size,
-			.memoryTypeIndex = vertexbufferMemoryTypeIndex,
-		});
-		logicalDevice.bindBufferMemory(vertexbuffer, vertexbufferMemory, 0);
-		auto vertexbufferDeviceDataPtr = static_cast<std::uint8_t *>(logicalDevice.mapMemory(vertexbufferMemory, 0, vertexbufferMemoryRequirements.size));
-		std::memcpy(vertexbufferDeviceDataPtr, vertexData, sizeof(vertexData));
-		logicalDevice.unmapMemory(vertexbufferMemory);
+		std::memcpy(vertexbuffer.allocation.mappedData, vertexData, sizeof(vertexData));
 	}
 
 	void initSwapchain() {
@@ -402,10 +393,10 @@ struct HelloTriangle {
 				if (renderpass)
 					logicalDevice.destroyRenderPass(renderpass);
 
-				if (vertexbufferMemory)
-					logicalDevice.freeMemory(vertexbufferMemory);
-				if (vertexbuffer)
-					logicalDevice.destroyBuffer(vertexbuffer);
+				if (memoryAllocator) {
+					memoryAllocator->destroyBuffer(vertexbuffer);
+					memoryAllocator.reset();
+				}
 			}
 		}
 	}
@@ -469,7 +460,7 @@ struct HelloTriangle {
 			},
 			vk::SubpassContents::eInline);
 		graphicsCommandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, graphicsPipeline);
-		graphicsCommandBuffer.bindVertexBuffers(0, vertexbuffer, {0});
+		graphicsCommandBuffer.bindVertexBuffers(0, *vertexbuffer.buffer, {0});
 
 		graphicsCommandBuffer.setViewport(0, vk::Viewport(0.0f, 0.0f, static_cast<float>(swapchainDetails.extent.width), static_cast<float>(swapchainDetails.extent.height), 0.0f, 1.0f));
 		graphicsCommandBuffer.setScissor(0, vk::Rect2D(vk::Offset2D(0, 0), {swapchainDetails.extent.width, swapchainDetails.extent.height}));
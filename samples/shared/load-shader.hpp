@@ -3,6 +3,12 @@
 #include <fmt/core.h>
 #include <filesystem>
 #include <fstream>
+#include <atomic>
+#include <cstring>
+#include <cstddef>
+#include <exception>
+#include <system_error>
+#include <thread>
 
 #include <SPIRV/GlslangToSpv.h>
 #include <glslang/Include/ResourceLimits.h>
@@ -114,7 +120,7 @@ static constexpr TBuiltInResource getResource() {
 		},
 	};
 }
-static std::vector<std::uint32_t> glslToSpv(vk::ShaderStageFlagBits shader_stage, const std::string &glsl_code) {
+static std::vector<std::uint32_t> glslToSpv(vk::ShaderStageFlagBits shader_stage, const std::string &glsl_code, const TBuiltInResource &resource = getResource()) {
 	auto translate_shader_stage = [](vk::ShaderStageFlagBits stage) -> EShLanguage {
 		switch (stage) {
 		case vk::ShaderStageFlagBits::eVertex: return EShLangVertex;
@@ -139,7 +145,6 @@ static std::vector<std::uint32_t> glslToSpv(vk::ShaderStageFlagBits shader_stage
 	glslang::TShader shader(stage);
 	shader.setStrings(shader_strings, 1);
 	auto messages = static_cast<EShMessages>(EShMsgSpvRules | EShMsgVulkanRules);
-	TBuiltInResource resource = getResource();
 	if (!shader.parse(&resource, 100, false, messages))
 		throw std::runtime_error(fmt::format("{}\n{}", shader.getInfoLog(), shader.getInfoDebugLog()).c_str());
 	glslang::TProgram program;
@@ -167,19 +172,161 @@ static std::string textFileToString(const std::filesystem::path &filepath) {
 	}
 	return sourceString;
 }
-static std::vector<std::uint32_t> loadGlslShaderToSpv(const std::filesystem::path &filepath) {
-	auto sourceString = textFileToString(filepath);
-	vk::ShaderStageFlagBits shaderStage;
-
+static vk::ShaderStageFlagBits shaderStageFromExtension(const std::filesystem::path &filepath) {
 	if (filepath.extension() == ".vert") {
-		shaderStage = vk::ShaderStageFlagBits::eVertex;
+		return vk::ShaderStageFlagBits::eVertex;
 	} else if (filepath.extension() == ".frag") {
-		shaderStage = vk::ShaderStageFlagBits::eFragment;
+		return vk::ShaderStageFlagBits::eFragment;
 	} else if (filepath.extension() == ".comp") {
-		shaderStage = vk::ShaderStageFlagBits::eCompute;
-	} else {
-		throw std::runtime_error(fmt::format("Attempting to load a currently unsupported shader file stage '{}'", filepath.extension().string()).c_str());
+		return vk::ShaderStageFlagBits::eCompute;
 	}
-
-	return glslToSpv(shaderStage, sourceString);
+	throw std::runtime_error(fmt::format("Attempting to load a currently unsupported shader file stage '{}'", filepath.extension().string()).c_str());
 }
+static std::vector<std::uint32_t> loadGlslShaderToSpv(const std::filesystem::path &filepath) {
+	return glslToSpv(shaderStageFromExtension(filepath), textFileToString(filepath));
+}
+
+// Compiles glsl to spv and keeps the results in an on disk cache, keyed by the source, stage and resource limits.
+// Keeps glslang initialized for as long as it lives, the initialization is reference counted by glslang.
+class ShaderCompiler {
+public:
+	explicit ShaderCompiler(std::filesystem::path cacheDirectory, const TBuiltInResource &resource = getResource())
+		: cacheDirectory{std::move(cacheDirectory)}, resource{resource} {
+		std::filesystem::create_directories(this->cacheDirectory);
+		resourceHash = hashResource(resource);
+		glslang::InitializeProcess();
+	}
+	~ShaderCompiler() {
+		glslang::FinalizeProcess();
+	}
+	ShaderCompiler(const ShaderCompiler &) = delete;
+	ShaderCompiler &operator=(const ShaderCompiler &) = delete;
+
+	std::vector<std::uint32_t> compile(vk::ShaderStageFlagBits stage, const std::string &glsl) const {
+		const auto cachePath = cacheDirectory / fmt::format("{:016x}.spv", cacheKey(stage, glsl));
+		if (auto spv = readCachedSpv(cachePath)) {
+			return std::move(*spv);
+		}
+
+		auto spv = glslToSpv(stage, glsl, resource);
+		writeCachedSpv(cachePath, spv);
+		return spv;
+	}
+	std::vector<std::uint32_t> compileFile(const std::filesystem::path &filepath) const {
+		return compile(shaderStageFromExtension(filepath), textFileToString(filepath));
+	}
+	// Compiles all files on a pool of threads, the results are in the order of the given files.
+	// If any of the files fails to compile, the first error is rethrown once all threads are done.
+	std::vector<std::vector<std::uint32_t>> compileFiles(const std::vector<std::filesystem::path> &filepaths, std::uint32_t threadCount = std::thread::hardware_concurrency()) const {
+		std::vector<std::vector<std::uint32_t>> results(filepaths.size());
+		std::vector<std::exception_ptr> errors(filepaths.size());
+		std::atomic<std::size_t> nextIndex{0};
+
+		auto worker = [&]() {
+			for (std::size_t i = nextIndex++; i < filepaths.size(); i = nextIndex++) {
+				try {
+					results[i] = compileFile(filepaths[i]);
+				} catch (...) {
+					errors[i] = std::current_exception();
+				}
+			}
+		};
+		threadCount = std::max(1u, std::min<std::uint32_t>(threadCount, static_cast<std::uint32_t>(filepaths.size())));
+		{
+			// joins on every way out of the scope, a joinable thread being destroyed would terminate
+			struct Workers {
+				std::vector<std::thread> threads;
+				~Workers() {
+					for (auto &thread : threads) {
+						thread.join();
+					}
+				}
+			} workers;
+			workers.threads.reserve(threadCount - 1);
+			for (std::uint32_t i = 1; i < threadCount; i++) {
+				try {
+					workers.threads.emplace_back(worker);
+				} catch (const std::system_error &) {
+					// the threads that did start and this one still take every file
+					break;
+				}
+			}
+			worker();
+		}
+
+		for (auto &error : errors) {
+			if (error) {
+				std::rethrow_exception(error);
+			}
+		}
+		return results;
+	}
+
+private:
+	// bump when the cached files would change for the same key, e.g. with a different glslang version
+	static constexpr std::uint64_t CACHE_FORMAT_VERSION = 1;
+
+	static std::uint64_t hashBytes(std::uint64_t hash, const void *data, std::size_t size) {
+		// FNV-1a
+		const auto *bytes = static_cast<const unsigned char *>(data);
+		for (std::size_t i = 0; i < size; i++) {
+			hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+		}
+		return hash;
+	}
+	static std::uint64_t hashResource(const TBuiltInResource &resource) {
+		// Everything besides the limits is an int, so only the gaps around the bools of the limits are padding,
+		// whose bytes are unspecified and must not end up in the key.
+		const std::size_t limitsEnd = offsetof(TBuiltInResource, limits) + sizeof(TLimits);
+		const std::size_t intsAfterLimits = (limitsEnd + alignof(int) - 1) / alignof(int) * alignof(int);
+		const auto *bytes = reinterpret_cast<const unsigned char *>(&resource);
+		const std::uint64_t hash = hashBytes(CACHE_FORMAT_VERSION, bytes, limitsEnd);
+		return hashBytes(hash, bytes + intsAfterLimits, sizeof(TBuiltInResource) - intsAfterLimits);
+	}
+	std::uint64_t cacheKey(vk::ShaderStageFlagBits stage, const std::string &glsl) const {
+		const auto stageValue = static_cast<std::uint32_t>(stage);
+		std::uint64_t hash = hashBytes(0xcbf29ce484222325ull ^ resourceHash, &stageValue, sizeof(stageValue));
+		return hashBytes(hash, glsl.data(), glsl.size());
+	}
+	static std::optional<std::vector<std::uint32_t>> readCachedSpv(const std::filesystem::path &cachePath) {
+		std::ifstream file{cachePath, std::ios::ate | std::ios::binary};
+		if (!file.is_open()) {
+			return std::nullopt;
+		}
+		const auto fileSize = static_cast<std::size_t>(file.tellg());
+		if (fileSize == 0 || fileSize % sizeof(std::uint32_t) != 0) {
+			return std::nullopt;
+		}
+		std::vector<std::uint32_t> spv(fileSize / sizeof(std::uint32_t));
+		file.seekg(0);
+		file.read(reinterpret_cast<char *>(spv.data()), fileSize);
+		if (!file.good() || spv[0] != 0x07230203) {
+			return std::nullopt;
+		}
+		return spv;
+	}
+	static void writeCachedSpv(const std::filesystem::path &cachePath, const std::vector<std::uint32_t> &spv) {
+		// threads compiling the same source must not write into the same temporary file
+		auto tempPath = cachePath;
+		tempPath += fmt::format(".{}.tmp", std::hash<std::thread::id>{}(std::this_thread::get_id()));
+		{
+			std::ofstream file{tempPath, std::ios::binary | std::ios::trunc};
+			if (!file.is_open()) {
+				return;
+			}
+			file.write(reinterpret_cast<const char *>(spv.data()), spv.size() * sizeof(std::uint32_t));
+			if (!file.good()) {
+				return;
+			}
+		}
+		std::error_code error;
+		std::filesystem::rename(tempPath, cachePath, error);
+		if (error) {
+			std::filesystem::remove(tempPath, error);
+		}
+	}
+
+	std::filesystem::path cacheDirectory;
+	TBuiltInResource resource;
+	std::uint64_t resourceHash;
+};
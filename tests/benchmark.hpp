@@ -0,0 +1,15 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+
+// Runs the function the given number of times and returns the average duration of one run in microseconds.
+template <typename Function>
+double measureMicroseconds(std::size_t iterations, Function &&function) {
+	auto start = std::chrono::steady_clock::now();
+	for (std::size_t i = 0; i < iterations; ++i) {
+		function();
+	}
+	std::chrono::duration<double, std::micro> duration = std::chrono::steady_clock::now() - start;
+	return duration.count() / static_cast<double>(iterations);
+}
@@ -0,0 +1,358 @@
+#define VULKANHELPER_IMPLEMENTATION
+#include <vulkanhelper.hpp>
+
+#include <barrier>
+
+#include "test-device.hpp"
+#include "benchmark.hpp"
+
+// not part of ctest, run it by hand and compare the printed numbers
+
+std::vector<uint32_t> loadShader(const char *name) {
+	std::ifstream file(std::filesystem::path{VULKANHELPER_TEST_SHADER_DIRECTORY} / name, std::ios::binary | std::ios::ate);
+	CHECK(file.is_open());
+	std::vector<uint32_t> spv(static_cast<std::size_t>(file.tellg()) / sizeof(uint32_t));
+	file.seekg(0);
+	file.read(reinterpret_cast<char *>(spv.data()), spv.size() * sizeof(uint32_t));
+	return spv;
+}
+
+std::vector<std::uint32_t> threadCounts() {
+	std::vector<std::uint32_t> counts;
+	const std::uint32_t maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	for (std::uint32_t count = 1; count < maxThreads; count *= 2) {
+		counts.push_back(count);
+	}
+	counts.push_back(maxThreads);
+	return counts;
+}
+
+void benchmarkPipelineBatchCompiler(const TestDevice &testDevice) {
+	constexpr std::uint32_t pipelineCount = 256;
+	vk::Device device = *testDevice.device;
+	auto spv = loadShader("specialized.comp.spv");
+	vkh::DescriptorSetLayoutCache layoutCache{device};
+
+	const vk::SpecializationMapEntry entry{.constantID = 0, .offset = 0, .size = sizeof(std::uint32_t)};
+	std::vector<std::uint32_t> variants(pipelineCount);
+	std::vector<vk::SpecializationInfo> specializations(pipelineCount);
+	for (std::uint32_t i = 0; i < pipelineCount; ++i) {
+		specializations[i] = vk::SpecializationInfo{
+			.mapEntryCount = 1,
+			.pMapEntries = &entry,
+			.dataSize = sizeof(std::uint32_t),
+			.pData = &variants[i],
+		};
+	}
+
+	std::printf("pipeline batch compiler, %u compute pipelines:\n", pipelineCount);
+	double singleThreaded = 0;
+	std::uint32_t round = 0;
+	for (std::uint32_t threadCount : threadCounts()) {
+		// every round uses new variants, so the driver can't hand out pipelines it compiled before
+		for (std::uint32_t i = 0; i < pipelineCount; ++i) {
+			variants[i] = round * pipelineCount + i;
+		}
+		++round;
+
+		vkh::PipelineBatchCompiler compiler{device, nullptr, threadCount};
+		std::vector<std::future<vkh::Pipeline>> pipelines;
+		for (std::uint32_t i = 0; i < pipelineCount; ++i) {
+			pipelines.push_back(compiler.add(vkh::ComputePipelineBuilder{device}
+												 .setShaderStage(&spv, {}, &specializations[i])
+												 .reflectSPVForDescriptors(layoutCache)
+												 .reflectSPVForPushConstants()));
+		}
+		const double milliseconds = measureMicroseconds(1, [&]() {
+			compiler.compile();
+			for (auto &pipeline : pipelines) {
+				pipeline.get();
+			}
+		}) / 1000.0;
+		if (threadCount == 1) {
+			singleThreaded = milliseconds;
+		}
+		std::printf("  %2u threads: %8.2f ms, %.2fx\n", threadCount, milliseconds, singleThreaded / milliseconds);
+	}
+}
+
+void benchmarkDescriptorSetBatch(const TestDevice &testDevice) {
+	constexpr std::size_t frameCount = 20;
+	vk::Device device = *testDevice.device;
+	vkh::MemoryAllocator memoryAllocator{device, testDevice.physicalDevice};
+	auto buffer = memoryAllocator.createBuffer(vk::BufferCreateInfo{
+												   .size = 1 << 20,
+												   .usage = vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
+											   },
+											   vk::MemoryPropertyFlagBits::eDeviceLocal);
+	const vk::DescriptorSetLayoutBinding uniformBinding{.binding = 0, .descriptorType = vk::DescriptorType::eUniformBuffer, .descriptorCount = 1, .stageFlags = vk::ShaderStageFlagBits::eAll};
+	const vk::DescriptorSetLayoutBinding storageBinding{.binding = 1, .descriptorType = vk::DescriptorType::eStorageBuffer, .descriptorCount = 1, .stageFlags = vk::ShaderStageFlagBits::eAll};
+	vkh::DescriptorSetLayoutCache layoutCache{device};
+	const vk::DescriptorSetLayout layout = layoutCache.getLayout(std::vector{uniformBinding, storageBinding});
+	// one builder is reused for all sets, so neither path allocates once warmed up
+	auto fillBuilder = [&](vkh::DescriptorSetBuilder &builder, std::uint32_t i) -> vkh::DescriptorSetBuilder & {
+		const vk::DeviceSize offset = (i % 4096) * 256;
+		return builder.clear()
+			.addBufferBinding(uniformBinding, {.buffer = *buffer.buffer, .offset = offset, .range = 256})
+			.addBufferBinding(storageBinding, {.buffer = *buffer.buffer, .offset = offset, .range = 256});
+	};
+
+	for (std::uint32_t setCount : {1000u, 10000u}) {
+		vkh::GeneralDescriptorSetAllocator allocator{device, {{vk::DescriptorType::eUniformBuffer, setCount}, {vk::DescriptorType::eStorageBuffer, setCount}}, {}, setCount};
+		vkh::DescriptorSetBuilder builder{&allocator, layout};
+		const double single = measureMicroseconds(frameCount, [&]() {
+			allocator.reset();
+			for (std::uint32_t i = 0; i < setCount; ++i) {
+				fillBuilder(builder, i).build();
+			}
+		});
+		vkh::DescriptorSetBatch batch{&allocator};
+		const double batched = measureMicroseconds(frameCount, [&]() {
+			allocator.reset();
+			for (std::uint32_t i = 0; i < setCount; ++i) {
+				batch.stage(fillBuilder(builder, i));
+			}
+			batch.flush();
+		});
+		std::printf("descriptor sets, %5u sets per frame: build() %9.1f us, batch %9.1f us, %.2fx\n", setCount, single, batched, single / batched);
+	}
+	memoryAllocator.destroyBuffer(buffer);
+}
+
+void benchmarkDescriptorSetLayoutLookup(const TestDevice &testDevice) {
+	constexpr std::uint32_t layoutCount = 10000;
+	constexpr std::size_t lookupCount = 1000000;
+	const vk::DescriptorType types[] = {vk::DescriptorType::eUniformBuffer, vk::DescriptorType::eStorageBuffer, vk::DescriptorType::eCombinedImageSampler, vk::DescriptorType::eStorageImage};
+
+	std::vector<std::array<vk::DescriptorSetLayoutBinding, 3>> bindingSets(layoutCount);
+	for (std::uint32_t i = 0; i < layoutCount; ++i) {
+		for (std::uint32_t b = 0; b < 3; ++b) {
+			bindingSets[i][b] = vk::DescriptorSetLayoutBinding{
+				.binding = b,
+				.descriptorType = types[(i >> (1 + 2 * b)) % 4],
+				.descriptorCount = (i >> 7) + 1 + b,
+				.stageFlags = i % 2 == 0 ? vk::ShaderStageFlags{vk::ShaderStageFlagBits::eAll} : vk::ShaderStageFlagBits::eFragment,
+			};
+		}
+	}
+
+	vkh::DescriptorSetLayoutCache layoutCache{*testDevice.device};
+	for (const auto &bindings : bindingSets) {
+		layoutCache.getLayout(std::span<const vk::DescriptorSetLayoutBinding>{bindings});
+	}
+	CHECK(layoutCache.size() == layoutCount);
+
+	// a fixed pseudo random order, so the lookups don't just walk the table
+	std::uint32_t index = 0;
+	const double nanoseconds = measureMicroseconds(lookupCount, [&]() {
+		index = (index + 7919) % layoutCount;
+		layoutCache.getLayout(std::span<const vk::DescriptorSetLayoutBinding>{bindingSets[index]});
+	}) * 1000.0;
+	std::printf("descriptor set layout cache, %u cached layouts: %.1f ns per lookup\n", layoutCount, nanoseconds);
+}
+
+void benchmarkDescriptorUpdateTemplate(const TestDevice &testDevice) {
+	constexpr std::size_t frameCount = 20;
+	vk::Device device = *testDevice.device;
+	vkh::MemoryAllocator memoryAllocator{device, testDevice.physicalDevice};
+	auto buffer = memoryAllocator.createBuffer(vk::BufferCreateInfo{
+												   .size = 1 << 20,
+												   .usage = vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
+											   },
+											   vk::MemoryPropertyFlagBits::eDeviceLocal);
+	std::array<vk::DescriptorSetLayoutBinding, 4> bindings;
+	for (std::uint32_t b = 0; b < bindings.size(); ++b) {
+		bindings[b] = vk::DescriptorSetLayoutBinding{
+			.binding = b,
+			.descriptorType = b % 2 == 0 ? vk::DescriptorType::eUniformBuffer : vk::DescriptorType::eStorageBuffer,
+			.descriptorCount = 1,
+			.stageFlags = vk::ShaderStageFlagBits::eAll,
+		};
+	}
+	vkh::DescriptorSetLayoutCache layoutCache{device};
+	const vk::DescriptorSetLayout layout = layoutCache.getLayout(std::span<const vk::DescriptorSetLayoutBinding>{bindings});
+
+	for (std::uint32_t setCount : {1000u, 10000u}) {
+		vkh::GeneralDescriptorSetAllocator allocator{device, {{vk::DescriptorType::eUniformBuffer, 2 * setCount}, {vk::DescriptorType::eStorageBuffer, 2 * setCount}}, {}, setCount};
+		// a builder with the layout cache writes through the update template, one with a fixed layout writes the sets
+		auto measure = [&](auto makeBuilder) {
+			return measureMicroseconds(frameCount, [&]() {
+				allocator.reset();
+				for (std::uint32_t i = 0; i < setCount; ++i) {
+					vkh::DescriptorSetBuilder builder = makeBuilder();
+					for (const auto &binding : bindings) {
+						builder.addBufferBinding(binding, {.buffer = *buffer.buffer, .offset = ((i + binding.binding) % 4096) * 256, .range = 256});
+					}
+					builder.build();
+				}
+			});
+		};
+		const double writes = measure([&]() { return vkh::DescriptorSetBuilder{&allocator, layout}; });
+		const double updateTemplate = measure([&]() { return vkh::DescriptorSetBuilder{&allocator, &layoutCache}; });
+		std::printf("descriptor updates, %5u sets per frame: writes %9.1f us, update template %9.1f us, %.2fx\n", setCount, writes, updateTemplate, writes / updateTemplate);
+	}
+	memoryAllocator.destroyBuffer(buffer);
+}
+
+// The draws are recorded as dispatches of a compute pipeline, which needs no render pass or attachments,
+// the cost of writing the commands on the cpu is what is measured.
+void benchmarkThreadedCommandRecording(const TestDevice &testDevice) {
+	constexpr std::uint32_t drawCount = 100000;
+	constexpr std::uint32_t maxThreadCount = 16;
+	constexpr std::size_t frameCount = 10;
+	vk::Device device = *testDevice.device;
+	auto spv = loadShader("specialized.comp.spv");
+	vkh::DescriptorSetLayoutCache layoutCache{device};
+	vkh::Pipeline pipeline = vkh::ComputePipelineBuilder{device}.setShaderStage(&spv).reflectSPVForDescriptors(layoutCache).build();
+
+	vkh::MemoryAllocator memoryAllocator{device, testDevice.physicalDevice};
+	auto buffer = memoryAllocator.createBuffer(vk::BufferCreateInfo{.size = 1 << 20, .usage = vk::BufferUsageFlagBits::eStorageBuffer}, vk::MemoryPropertyFlagBits::eDeviceLocal);
+	vkh::GeneralDescriptorSetAllocator descriptorAllocator{device};
+	const vk::DescriptorSet set = vkh::DescriptorSetBuilder{&descriptorAllocator, &layoutCache}
+									  .addBufferBinding({.binding = 0, .descriptorType = vk::DescriptorType::eStorageBuffer, .descriptorCount = 1, .stageFlags = vk::ShaderStageFlagBits::eCompute},
+														{.buffer = *buffer.buffer, .offset = 0, .range = VK_WHOLE_SIZE})
+									  .build();
+
+	vkh::ThreadedCommandContext context{device, testDevice.queueFamilyIndex, maxThreadCount, 1};
+	const vk::CommandBufferInheritanceInfo inheritanceInfo{};
+	auto record = [&](std::uint32_t count) {
+		vk::CommandBuffer secondary = context.getSecondary();
+		secondary.begin(vk::CommandBufferBeginInfo{.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit, .pInheritanceInfo = &inheritanceInfo});
+		secondary.bindPipeline(vk::PipelineBindPoint::eCompute, *pipeline.pipeline);
+		for (std::uint32_t i = 0; i < count; ++i) {
+			secondary.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipeline.getLayout(), 0, set, {});
+			secondary.dispatch(1, 1, 1);
+		}
+		context.endSecondary(secondary);
+		context.unregisterThread();
+	};
+
+	std::printf("threaded command recording, %u draws:\n", drawCount);
+	double singleThreaded = 0;
+	for (std::uint32_t threadCount = 1; threadCount <= maxThreadCount; threadCount *= 2) {
+		const double milliseconds = measureMicroseconds(frameCount, [&]() {
+			context.beginFrame(0);
+			std::vector<std::thread> threads;
+			for (std::uint32_t t = 0; t < threadCount; ++t) {
+				threads.emplace_back(record, drawCount / threadCount + (t < drawCount % threadCount ? 1 : 0));
+			}
+			for (auto &thread : threads) {
+				thread.join();
+			}
+			vk::CommandBuffer primary = context.getPrimary();
+			primary.begin(vk::CommandBufferBeginInfo{.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+			context.executeSecondaries(primary);
+			primary.end();
+			context.unregisterThread();
+		}) / 1000.0;
+		if (threadCount == 1) {
+			singleThreaded = milliseconds;
+		}
+		std::printf("  %2u threads: %8.2f ms, %.2fx\n", threadCount, milliseconds, singleThreaded / milliseconds);
+	}
+	memoryAllocator.destroyBuffer(buffer);
+}
+
+struct IntPoolPolicy {
+	int next{0};
+
+	int create() { return next++; }
+	void reset(int) {}
+	void destroy(int) {}
+};
+
+// host only, compares the inlined policy calls with the std::function calls of the default policy
+void benchmarkPoolPolicies() {
+	constexpr std::size_t frameCount = 20000;
+	constexpr int elementsPerFrame = 256;
+	auto measure = [&](auto &pool) {
+		long long sum = 0;
+		const double nanoseconds = measureMicroseconds(frameCount, [&]() {
+			for (int i = 0; i < elementsPerFrame; ++i) {
+				sum += pool.get();
+			}
+			pool.flush();
+		}) * 1000.0 / elementsPerFrame;
+		// keeps the compiler from dropping the gets
+		CHECK(sum >= 0);
+		return nanoseconds;
+	};
+
+	int next = 0;
+	vkh::Pool<int> functionPool{[&]() { return next++; }, [](int) {}, [](int) {}};
+	vkh::Pool<int, IntPoolPolicy> policyPool;
+	const double function = measure(functionPool);
+	const double inlined = measure(policyPool);
+	std::printf("pool, get and flush of %d elements per frame: FunctionPoolPolicy %.2f ns, inlined policy %.2f ns per element, %.2fx\n", elementsPerFrame, function, inlined, function / inlined);
+}
+
+// create() of ConcurrentPool policies has to be thread safe
+struct AtomicIntPoolPolicy {
+	std::atomic<int> *next;
+
+	int create() { return next->fetch_add(1, std::memory_order_relaxed); }
+	void reset(int) {}
+	void destroy(int) {}
+};
+
+// host only, gets and flushes of many threads at once, elements are recycled framesInFlight frames later
+void benchmarkConcurrentPoolScaling() {
+	constexpr std::size_t frameCount = 2000;
+	constexpr std::uint32_t framesInFlight = 3;
+	constexpr int elementsPerThread = 1024;
+	std::printf("concurrent pool, get and flush of %d elements per thread and frame:\n", elementsPerThread);
+	double singleThreaded = 0.0;
+	for (std::uint32_t threadCount : threadCounts()) {
+		std::atomic<int> next{0};
+		vkh::ConcurrentPool<int, AtomicIntPoolPolicy> pool{AtomicIntPoolPolicy{&next}, framesInFlight};
+		std::barrier frameStart{threadCount + 1};
+		std::barrier frameEnd{threadCount + 1};
+		std::atomic<bool> running{true};
+		std::vector<std::thread> threads;
+		for (std::uint32_t t = 0; t < threadCount; ++t) {
+			threads.emplace_back([&]() {
+				long long sum = 0;
+				while (true) {
+					frameStart.arrive_and_wait();
+					if (!running.load(std::memory_order_relaxed)) {
+						break;
+					}
+					for (int i = 0; i < elementsPerThread; ++i) {
+						sum += pool.get();
+					}
+					pool.flush();
+					frameEnd.arrive_and_wait();
+				}
+				// keeps the compiler from dropping the gets
+				CHECK(sum >= 0);
+			});
+		}
+		const double microseconds = measureMicroseconds(frameCount, [&]() {
+			frameStart.arrive_and_wait();
+			frameEnd.arrive_and_wait();
+			pool.advanceEpoch();
+		});
+		running.store(false, std::memory_order_relaxed);
+		frameStart.arrive_and_wait();
+		for (auto &thread : threads) {
+			thread.join();
+		}
+		const double getsPerMicrosecond = threadCount * elementsPerThread / microseconds;
+		if (threadCount == 1) {
+			singleThreaded = getsPerMicrosecond;
+		}
+		std::printf("  %2u threads: %8.2f million gets per second, %.2fx\n", threadCount, getsPerMicrosecond, getsPerMicrosecond / singleThreaded);
+	}
+}
+
+int main() {
+	benchmarkPoolPolicies();
+	benchmarkConcurrentPoolScaling();
+	if (auto testDevice = createTestDevice()) {
+		benchmarkPipelineBatchCompiler(*testDevice);
+		benchmarkDescriptorSetBatch(*testDevice);
+		benchmarkDescriptorSetLayoutLookup(*testDevice);
+		benchmarkDescriptorUpdateTemplate(*testDevice);
+		benchmarkThreadedCommandRecording(*testDevice);
+	}
+}
@@ -1,10 +1,21 @@
 #define VULKANHELPER_IMPLEMENTATION
 #include <vulkanhelper.hpp>
 
+#include <atomic>
+#include <barrier>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <set>
+#include <thread>
+
+#include "test-device.hpp"
+
 std::size_t deviceRating(vk::PhysicalDevice) {
 	return 0;
 }
 
+// only checks that the api compiles, it is never run
 void testSuite() {
 	std::vector<const char *> vectorCString = {"adsda", "asdasdwaa", "wadsdawdw"};
 	vk::Instance inst[] = {
@@ -32,8 +43,691 @@ void testSuite() {
 		vkh::createLogicalDevice(physicalDevices[0], {0, 2, 3}, {"extensions", "other ext"}),
 		vkh::createLogicalDevice(physicalDevices[0], {1, 1, 3}, {"1ext"}),
 		vkh::createLogicalDevice(physicalDevices[0], {0, 0, 0}, vectorCString),
+		vkh::createLogicalDevice(physicalDevices[0], {0}, vectorCString, true),
 	};
 }
 
+// every unique set of bindings has to map to exactly one layout, no matter how many threads race for it
+void testDescriptorSetLayoutCacheConcurrency(vk::Device device) {
+	constexpr std::uint32_t uniqueSetCount = 256;
+	constexpr std::uint32_t threadCount = 16;
+	constexpr std::uint32_t iterations = 100;
+
+	std::vector<std::vector<vk::DescriptorSetLayoutBinding>> bindingSets(uniqueSetCount);
+	for (std::uint32_t i = 0; i < uniqueSetCount; ++i) {
+		bindingSets[i].push_back({
+			.binding = 0,
+			.descriptorType = vk::DescriptorType::eUniformBuffer,
+			.descriptorCount = i % 16 + 1,
+			.stageFlags = vk::ShaderStageFlagBits::eAll,
+		});
+		bindingSets[i].push_back({
+			.binding = 1,
+			.descriptorType = vk::DescriptorType::eStorageBuffer,
+			.descriptorCount = i / 16 + 1,
+			.stageFlags = vk::ShaderStageFlagBits::eCompute,
+		});
+	}
+
+	vkh::DescriptorSetLayoutCache layoutCache{device};
+	std::vector<std::vector<vk::DescriptorSetLayout>> results(threadCount, std::vector<vk::DescriptorSetLayout>(uniqueSetCount));
+	std::vector<std::thread> threads;
+	for (std::uint32_t t = 0; t < threadCount; ++t) {
+		threads.emplace_back([&, t]() {
+			for (std::uint32_t iteration = 0; iteration < iterations; ++iteration) {
+				for (std::uint32_t i = 0; i < uniqueSetCount; ++i) {
+					std::uint32_t set = (i * 7 + t * 13) % uniqueSetCount;
+					auto layout = layoutCache.getLayout(bindingSets[set]);
+					if (iteration == 0) {
+						results[t][set] = layout;
+					}
+					CHECK(results[t][set] == layout);
+				}
+			}
+		});
+	}
+	for (auto &thread : threads) {
+		thread.join();
+	}
+
+	for (std::uint32_t t = 1; t < threadCount; ++t) {
+		CHECK(results[t] == results[0]);
+	}
+	CHECK(layoutCache.size() == uniqueSetCount);
+}
+
+// layouts with immutable samplers are keyed by the sampler handles, not by the address of the caller's array
+void testDescriptorSetLayoutCacheImmutableSamplers(vk::Device device) {
+	std::array<vk::UniqueSampler, 2> samplers;
+	for (auto &sampler : samplers) {
+		sampler = device.createSamplerUnique(vk::SamplerCreateInfo{});
+	}
+	auto bindingsFor = [](const vk::Sampler *immutableSamplers) {
+		return std::vector<vk::DescriptorSetLayoutBinding>{{
+			.binding = 0,
+			.descriptorType = vk::DescriptorType::eSampler,
+			.descriptorCount = 2,
+			.stageFlags = vk::ShaderStageFlagBits::eFragment,
+			.pImmutableSamplers = immutableSamplers,
+		}};
+	};
+
+	vkh::DescriptorSetLayoutCache layoutCache{device};
+	std::vector<vk::Sampler> first{*samplers[0], *samplers[1]};
+	const vk::DescriptorSetLayout layout = layoutCache.getLayout(bindingsFor(first.data()));
+
+	std::vector<vk::Sampler> copy = first;
+	CHECK(layoutCache.getLayout(bindingsFor(copy.data())) == layout);
+
+	// the cache must not read the caller's array after getLayout returned
+	first = {*samplers[1], *samplers[0]};
+	const vk::DescriptorSetLayout swapped = layoutCache.getLayout(bindingsFor(first.data()));
+	CHECK(swapped != layout);
+	CHECK(layoutCache.getLayout(bindingsFor(copy.data())) == layout);
+	CHECK(layoutCache.getLayout(bindingsFor(nullptr)) != layout);
+	CHECK(layoutCache.size() == 3);
+}
+
+// a batch that needs more descriptors than one pool holds gets split across pools
+void testDescriptorSetBatchSpansPools(const TestDevice &testDevice) {
+	constexpr std::uint32_t setCount = 22;
+	vk::Device device = *testDevice.device;
+	vkh::MemoryAllocator memoryAllocator{device, testDevice.physicalDevice};
+	auto buffer = memoryAllocator.createBuffer(vk::BufferCreateInfo{.size = 256, .usage = vk::BufferUsageFlagBits::eUniformBuffer}, vk::MemoryPropertyFlagBits::eDeviceLocal);
+	const vk::DescriptorSetLayoutBinding binding{.binding = 0, .descriptorType = vk::DescriptorType::eUniformBuffer, .descriptorCount = 1, .stageFlags = vk::ShaderStageFlagBits::eAll};
+
+	vkh::DescriptorSetLayoutCache layoutCache{device};
+	// every pool only holds the uniform buffers of 4 sets
+	vkh::GeneralDescriptorSetAllocator allocator{device, {{vk::DescriptorType::eUniformBuffer, 4}}, {}, 4};
+	vkh::DescriptorSetBuilder builder{&allocator, &layoutCache};
+	vkh::DescriptorSetBatch batch{&allocator};
+	// the second frame allocates from the reset pools of the first
+	for (int frame = 0; frame < 2; ++frame) {
+		allocator.reset();
+		for (std::uint32_t i = 0; i < setCount; ++i) {
+			CHECK(batch.stage(builder.clear().addBufferBinding(binding, {.buffer = *buffer.buffer, .offset = 0, .range = 256})) == i);
+		}
+		const auto sets = batch.flush();
+		CHECK(sets.size() == setCount);
+		std::set<VkDescriptorSet> distinct;
+		for (vk::DescriptorSet set : sets) {
+			CHECK(set);
+			distinct.insert(set);
+		}
+		CHECK(distinct.size() == setCount);
+	}
+	memoryAllocator.destroyBuffer(buffer);
+}
+
+// array bindings take one info per element, through the update template as well as through plain writes
+void testDescriptorSetBuilderArrayBindings(const TestDevice &testDevice) {
+	vk::Device device = *testDevice.device;
+	vkh::MemoryAllocator memoryAllocator{device, testDevice.physicalDevice};
+	auto buffer = memoryAllocator.createBuffer(vk::BufferCreateInfo{.size = 1024, .usage = vk::BufferUsageFlagBits::eUniformBuffer}, vk::MemoryPropertyFlagBits::eDeviceLocal);
+	const vk::DescriptorSetLayoutBinding binding{.binding = 0, .descriptorType = vk::DescriptorType::eUniformBuffer, .descriptorCount = 3, .stageFlags = vk::ShaderStageFlagBits::eAll};
+	const std::array<vk::DescriptorBufferInfo, 3> infos{{
+		{.buffer = *buffer.buffer, .offset = 0, .range = 256},
+		{.buffer = *buffer.buffer, .offset = 256, .range = 256},
+		{.buffer = *buffer.buffer, .offset = 512, .range = 256},
+	}};
+
+	vkh::DescriptorSetLayoutCache layoutCache{device};
+	vkh::GeneralDescriptorSetAllocator allocator{device};
+	vkh::DescriptorSetCache setCache{&allocator};
+	auto build = [&](std::span<const vk::DescriptorBufferInfo> bufferInfos) {
+		return vkh::DescriptorSetBuilder{&allocator, &layoutCache}.setSetCache(&setCache).addBufferBinding(binding, bufferInfos).build();
+	};
+	const vk::DescriptorSet set = build(infos);
+	CHECK(set);
+	CHECK(build(infos) == set);
+	// every element is part of the key, not only the first one
+	auto otherLast = infos;
+	otherLast[2].offset = 768;
+	CHECK(build(otherLast) != set);
+
+	// without a layout cache the builder writes the array with plain descriptor writes
+	const vk::DescriptorSetLayout layout = layoutCache.getLayout(std::span<const vk::DescriptorSetLayoutBinding>{&binding, 1});
+	CHECK(vkh::DescriptorSetBuilder{&allocator, layout}.addBufferBinding(binding, infos).build());
+	memoryAllocator.destroyBuffer(buffer);
+}
+
+// spv of a shader doing nothing, the variant tells otherwise equal shaders apart without needing the shader corpus
+std::vector<uint32_t> emptyShaderSpv(vk::ShaderStageFlagBits stage, uint32_t variant) {
+	const bool compute = stage == vk::ShaderStageFlagBits::eCompute;
+	std::vector<uint32_t> spv{
+		0x07230203, 0x00010000, 0, 5, 0,
+		// OpCapability Shader
+		0x00020011, 1,
+		// OpMemoryModel Logical GLSL450
+		0x0003000e, 0, 1,
+		// OpEntryPoint GLCompute/Vertex %1 "main"
+		0x0005000f, compute ? 5u : 0u, 1, 0x6e69616d, 0,
+	};
+	if (compute) {
+		// OpExecutionMode %1 LocalSize 1 1 1
+		spv.insert(spv.end(), {0x00060010, 1, 17, 1, 1, 1});
+	}
+	spv.insert(spv.end(), {
+		// OpSource Unknown variant
+		0x00030003, 0, variant,
+		// %2 = OpTypeVoid, %3 = OpTypeFunction %2
+		0x00020013, 2,
+		0x00030021, 3, 2,
+		// %1 = OpFunction %2 None %3, OpLabel, OpReturn, OpFunctionEnd
+		0x00050036, 2, 1, 0, 3,
+		0x000200f8, 4,
+		0x000100fd,
+		0x00010038,
+	});
+	return spv;
+}
+
+// equal spv shares one module, trim() only destroys the modules nobody else holds anymore
+void testShaderModuleCacheSharing(vk::Device device) {
+	vkh::ShaderModuleCache cache{device};
+	const std::vector<uint32_t> spv = emptyShaderSpv(vk::ShaderStageFlagBits::eCompute, 0);
+	std::shared_ptr<vk::UniqueShaderModule> module = cache.get(spv);
+	CHECK(module && *module);
+	// equal words in other storage
+	const std::vector<uint32_t> copy = spv;
+	CHECK(cache.get(copy) == module);
+
+	std::shared_ptr<vk::UniqueShaderModule> other = cache.get(emptyShaderSpv(vk::ShaderStageFlagBits::eCompute, 1));
+	CHECK(other != module);
+	CHECK(cache.size() == 2);
+
+	// a module held outside of the cache survives trim()
+	other.reset();
+	cache.trim();
+	CHECK(cache.size() == 1);
+	CHECK(cache.get(spv) == module);
+
+	module.reset();
+	cache.trim();
+	CHECK(cache.size() == 0);
+}
+
+// equal state makes equal keys and hits the map, a different shader or different flags miss
+void testPipelineCacheMap(vk::Device device) {
+	const vk::AttachmentDescription attachment{
+		.format = vk::Format::eB8G8R8A8Unorm,
+		.samples = vk::SampleCountFlagBits::e1,
+		.loadOp = vk::AttachmentLoadOp::eDontCare,
+		.storeOp = vk::AttachmentStoreOp::eDontCare,
+		.stencilLoadOp = vk::AttachmentLoadOp::eDontCare,
+		.stencilStoreOp = vk::AttachmentStoreOp::eDontCare,
+		.initialLayout = vk::ImageLayout::eUndefined,
+		.finalLayout = vk::ImageLayout::eColorAttachmentOptimal,
+	};
+	const vk::AttachmentReference colorReference{.attachment = 0, .layout = vk::ImageLayout::eColorAttachmentOptimal};
+	const vk::SubpassDescription subpass{.pipelineBindPoint = vk::PipelineBindPoint::eGraphics, .colorAttachmentCount = 1, .pColorAttachments = &colorReference};
+	const vk::UniqueRenderPass renderPass = device.createRenderPassUnique(vk::RenderPassCreateInfo{.attachmentCount = 1, .pAttachments = &attachment, .subpassCount = 1, .pSubpasses = &subpass});
+
+	const std::vector<uint32_t> vertexSpv = emptyShaderSpv(vk::ShaderStageFlagBits::eVertex, 0);
+	const std::vector<uint32_t> otherVertexSpv = emptyShaderSpv(vk::ShaderStageFlagBits::eVertex, 1);
+	auto rasterization = vkh::makeDefaultRasterisationStateCreateInfo(vk::PolygonMode::eFill);
+	// without rasterization the pipeline needs no fragment shader
+	rasterization.rasterizerDiscardEnable = VK_TRUE;
+	auto configure = [&](vkh::GraphicsPipelineBuilder &builder, const std::vector<uint32_t> *spv) -> vkh::GraphicsPipelineBuilder & {
+		return builder.setVertexInput({}).setRasterization(rasterization).addShaderStage(spv, vk::ShaderStageFlagBits::eVertex);
+	};
+	vkh::GraphicsPipelineBuilder first{device, *renderPass};
+	vkh::GraphicsPipelineBuilder same{device, *renderPass};
+	vkh::GraphicsPipelineBuilder otherShader{device, *renderPass};
+	vkh::GraphicsPipelineBuilder otherFlags{device, *renderPass};
+	configure(first, &vertexSpv);
+	configure(same, &vertexSpv);
+	configure(otherShader, &otherVertexSpv);
+	configure(otherFlags, &vertexSpv).setCreateFlags(vk::PipelineCreateFlagBits::eDisableOptimization);
+
+	CHECK(first.makeStateKey() == same.makeStateKey());
+	CHECK(first.makeStateKey() != otherShader.makeStateKey());
+	CHECK(first.makeStateKey() != otherFlags.makeStateKey());
+
+	vkh::PipelineCacheMap cacheMap;
+	const std::shared_ptr<vkh::Pipeline> pipeline = cacheMap.get(first);
+	CHECK(pipeline && pipeline->pipeline);
+	CHECK(cacheMap.get(same) == pipeline);
+	CHECK(cacheMap.get(otherShader) != pipeline);
+	CHECK(cacheMap.getHitCount() == 1);
+	CHECK(cacheMap.getMissCount() == 2);
+	CHECK(cacheMap.size() == 2);
+	CHECK(std::abs(cacheMap.getHitRate() - 1.0f / 3.0f) < 1e-6f);
+
+	cacheMap.clear();
+	CHECK(cacheMap.size() == 0);
+	CHECK(cacheMap.get(same) != pipeline);
+	CHECK(cacheMap.getMissCount() == 3);
+}
+
+// every thread allocates from its own pools, which are only reset when their frame comes around again
+// and the thread allocates in it
+void testFrameDescriptorAllocator(vk::Device device) {
+	constexpr std::uint32_t threadCount = 4;
+	constexpr std::uint32_t framesInFlight = 2;
+	constexpr std::uint32_t frameCount = 2 * framesInFlight + 1;
+	// the last thread skips the second frame
+	constexpr std::uint32_t idleThread = threadCount - 1;
+	constexpr std::uint32_t idleFrame = 1;
+	const vk::DescriptorSetLayoutBinding binding{.binding = 0, .descriptorType = vk::DescriptorType::eUniformBuffer, .descriptorCount = 1, .stageFlags = vk::ShaderStageFlagBits::eAll};
+	vkh::DescriptorSetLayoutCache layoutCache{device};
+	const vk::DescriptorSetLayout layout = layoutCache.getLayout(std::span<const vk::DescriptorSetLayoutBinding>{&binding, 1});
+	vkh::FrameDescriptorAllocator allocator{device, threadCount, framesInFlight, {{vk::DescriptorType::eUniformBuffer, 64}}, 64};
+
+	// resets every slot should have seen so far
+	std::array<std::array<uint64_t, framesInFlight>, threadCount> expectedResets{};
+	for (std::uint32_t frame = 0; frame < frameCount; ++frame) {
+		const std::uint32_t frameIndex = frame % framesInFlight;
+		allocator.beginFrame(frameIndex);
+		std::vector<std::thread> threads;
+		for (std::uint32_t threadIndex = 0; threadIndex < threadCount; ++threadIndex) {
+			if (threadIndex == idleThread && frame == idleFrame) {
+				continue;
+			}
+			threads.emplace_back([&, threadIndex]() {
+				for (int i = 0; i < 100; ++i) {
+					CHECK(allocator.allocate(threadIndex, layout, std::span<const vk::DescriptorSetLayoutBinding>{&binding, 1}));
+				}
+			});
+			// the first allocation of the thread in the frame resets its pools, many allocations never do
+			expectedResets[threadIndex][frameIndex]++;
+		}
+		for (auto &thread : threads) {
+			thread.join();
+		}
+
+		for (std::uint32_t threadIndex = 0; threadIndex < threadCount; ++threadIndex) {
+			for (std::uint32_t slotFrame = 0; slotFrame < framesInFlight; ++slotFrame) {
+				CHECK(allocator.getResetGeneration(threadIndex, slotFrame) == expectedResets[threadIndex][slotFrame]);
+			}
+		}
+	}
+}
+
+// buffers are allocated up front or in geometrically growing batches and handed out again after a flush
+void testCommandBufferAllocator(const TestDevice &testDevice) {
+	const vk::CommandPoolCreateInfo poolCI{.queueFamilyIndex = testDevice.queueFamilyIndex};
+	{
+		vkh::CommandBufferAllocator allocator{*testDevice.device, poolCI, vk::CommandBufferLevel::ePrimary, 20};
+		CHECK(allocator.capacity() == 20);
+		// the prewarmed buffers cover the first frames
+		for (int i = 0; i < 20; ++i) {
+			CHECK(allocator.getElement());
+		}
+		CHECK(allocator.capacity() == 20);
+		// growing doubles the capacity instead of allocating one buffer at a time
+		CHECK(allocator.getElement());
+		CHECK(allocator.capacity() == 40);
+	}
+
+	vkh::CommandBufferAllocator allocator{*testDevice.device, poolCI};
+	CHECK(allocator.capacity() == 0);
+	std::vector<vk::CommandBuffer> handedOut;
+	for (int i = 0; i < 5; ++i) {
+		handedOut.push_back(allocator.getElement());
+	}
+	CHECK(allocator.capacity() == 8);
+	// 5 used and 10 more requested cross the 8 allocated buffers
+	std::array<vk::CommandBuffer, 10> batch;
+	allocator.getElements(batch);
+	CHECK(allocator.capacity() == 16);
+	handedOut.insert(handedOut.end(), batch.begin(), batch.end());
+	// a request bigger than doubling allocates exactly what is needed
+	std::vector<vk::CommandBuffer> bigBatch(40);
+	allocator.getElements(bigBatch);
+	CHECK(allocator.capacity() == 55);
+	handedOut.insert(handedOut.end(), bigBatch.begin(), bigBatch.end());
+
+	std::set<VkCommandBuffer> distinct;
+	for (vk::CommandBuffer buffer : handedOut) {
+		CHECK(buffer);
+		distinct.insert(buffer);
+	}
+	CHECK(distinct.size() == handedOut.size());
+
+	// after a flush the same buffers are handed out again, in the same order, without allocating
+	allocator.flush();
+	std::vector<vk::CommandBuffer> reused(handedOut.size());
+	allocator.getElements(reused);
+	CHECK(reused == handedOut);
+	CHECK(allocator.capacity() == 55);
+}
+
+// payloads that only differ in padding or in the union member the descriptor type doesn't use have to match
+void testDescriptorSetCacheIgnoresUndefinedPayloadBytes() {
+	vkh::GeneralDescriptorSetAllocator allocator;
+	vkh::DescriptorSetCache setCache{&allocator};
+	const auto layout = vk::DescriptorSetLayout{reinterpret_cast<VkDescriptorSetLayout>(std::uintptr_t{0x10})};
+	const auto set = vk::DescriptorSet{reinterpret_cast<VkDescriptorSet>(std::uintptr_t{0x20})};
+	const vk::DescriptorSetLayoutBinding bindings[] = {
+		{.binding = 0, .descriptorType = vk::DescriptorType::eCombinedImageSampler, .descriptorCount = 1, .stageFlags = vk::ShaderStageFlagBits::eFragment},
+		{.binding = 1, .descriptorType = vk::DescriptorType::eUniformBuffer, .descriptorCount = 1, .stageFlags = vk::ShaderStageFlagBits::eFragment},
+	};
+
+	auto makePayload = [](unsigned char fill) {
+		std::array<vkh::DescriptorUpdatePayload, 2> payload;
+		std::memset(payload.data(), fill, sizeof(payload));
+		payload[0].image.sampler = reinterpret_cast<VkSampler>(std::uintptr_t{0x30});
+		payload[0].image.imageView = reinterpret_cast<VkImageView>(std::uintptr_t{0x40});
+		payload[0].image.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		payload[1].buffer = VkDescriptorBufferInfo{reinterpret_cast<VkBuffer>(std::uintptr_t{0x50}), 256, 64};
+		return payload;
+	};
+
+	auto inserted = makePayload(0x00);
+	setCache.insert(layout, bindings, inserted, set);
+	CHECK(setCache.find(layout, bindings, makePayload(0xab)) == set);
+
+	auto otherView = makePayload(0xab);
+	otherView[0].image.imageView = reinterpret_cast<VkImageView>(std::uintptr_t{0x41});
+	CHECK(!setCache.find(layout, bindings, otherView));
+	auto otherRange = makePayload(0x00);
+	otherRange[1].buffer.range = 128;
+	CHECK(!setCache.find(layout, bindings, otherRange));
+}
+
+// the heap has to refuse types the device can't update after binding, instead of failing later in the driver
+void testBindlessDescriptorHeapChecksUpdateAfterBind(const TestDevice &testDevice) {
+	auto features = testDevice.physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceDescriptorIndexingFeatures>();
+	const bool supported = features.get<vk::PhysicalDeviceDescriptorIndexingFeatures>().descriptorBindingUniformBufferUpdateAfterBind;
+	bool created = false;
+	try {
+		vkh::BindlessDescriptorHeap heap{*testDevice.device, testDevice.physicalDevice, {{vk::DescriptorType::eUniformBuffer, 64}}};
+		created = true;
+	} catch (const std::runtime_error &error) {
+		CHECK(std::strstr(error.what(), "descriptorBindingUniformBufferUpdateAfterBind"));
+	}
+	CHECK(created == supported);
+}
+
+// threads that unregister give their index back, so restarted workers don't run out of indices
+void testThreadedCommandContextReusesThreadIndices(const TestDevice &testDevice) {
+	vkh::ThreadedCommandContext context{*testDevice.device, testDevice.queueFamilyIndex, 2, 1};
+	context.beginFrame(0);
+	for (int generation = 0; generation < 4; ++generation) {
+		std::uint32_t indices[2];
+		std::thread workers[2];
+		for (int i = 0; i < 2; ++i) {
+			workers[i] = std::thread([&, i]() {
+				indices[i] = context.getThreadIndex();
+				CHECK(context.getSecondary());
+				context.unregisterThread();
+			});
+		}
+		for (auto &worker : workers) {
+			worker.join();
+		}
+		CHECK(indices[0] < 2 && indices[1] < 2);
+	}
+
+	// without unregistering, a third thread has no index left
+	std::thread first([&]() { context.getThreadIndex(); });
+	first.join();
+	std::thread second([&]() { context.getThreadIndex(); });
+	second.join();
+	bool threw = false;
+	std::thread third([&]() {
+		try {
+			context.getThreadIndex();
+		} catch (const std::runtime_error &) {
+			threw = true;
+		}
+	});
+	third.join();
+	CHECK(threw);
+}
+
+// a throwing record must neither leave an entry behind nor a buffer in the recording state
+void testStaticCommandBufferCacheRecordThrows(const TestDevice &testDevice) {
+	vk::Device device = *testDevice.device;
+	const vk::AttachmentDescription attachment{
+		.format = vk::Format::eR8G8B8A8Unorm,
+		.samples = vk::SampleCountFlagBits::e1,
+		.loadOp = vk::AttachmentLoadOp::eClear,
+		.storeOp = vk::AttachmentStoreOp::eStore,
+		.finalLayout = vk::ImageLayout::eColorAttachmentOptimal,
+	};
+	const vk::AttachmentReference colorReference{.attachment = 0, .layout = vk::ImageLayout::eColorAttachmentOptimal};
+	const vk::SubpassDescription subpass{.pipelineBindPoint = vk::PipelineBindPoint::eGraphics, .colorAttachmentCount = 1, .pColorAttachments = &colorReference};
+	auto renderPass = device.createRenderPassUnique(vk::RenderPassCreateInfo{.attachmentCount = 1, .pAttachments = &attachment, .subpassCount = 1, .pSubpasses = &subpass});
+	const vk::CommandBufferInheritanceInfo inheritanceInfo{.renderPass = *renderPass, .subpass = 0};
+
+	vkh::StaticCommandBufferCache cache{device, testDevice.queueFamilyIndex, 2};
+	cache.beginFrame();
+	for (int attempt = 0; attempt < 16; ++attempt) {
+		bool threw = false;
+		try {
+			cache.get(1, inheritanceInfo, {}, [](vk::CommandBuffer) { throw std::runtime_error("record failed"); });
+		} catch (const std::runtime_error &) {
+			threw = true;
+		}
+		CHECK(threw);
+		CHECK(cache.size() == 0);
+	}
+
+	int recordCount = 0;
+	auto record = [&](vk::CommandBuffer) { recordCount++; };
+	vk::CommandBuffer buffer = cache.get(1, inheritanceInfo, {}, record);
+	CHECK(cache.get(1, inheritanceInfo, {}, record) == buffer);
+	CHECK(recordCount == 1);
+	CHECK(cache.size() == 1);
+}
+
+struct CountingBatchPolicy {
+	int *created;
+	int *destroyed;
+	bool *failBatch;
+
+	int create() { return ++*created; }
+	void createBatch(std::span<int> elements) {
+		if (*failBatch) {
+			throw std::runtime_error("batch creation failed");
+		}
+		for (auto &element : elements) {
+			element = ++*created;
+		}
+	}
+	void reset(int) {}
+	void destroy(int element) {
+		// 0 is never created, destroying it would mean a default constructed element got into the pool
+		CHECK(element != 0);
+		++*destroyed;
+	}
+};
+
+// a throwing createBatch must not leave default constructed elements in the pool
+void testPoolCreateBatchThrows() {
+	int created = 0;
+	int destroyed = 0;
+	bool failBatch = true;
+	{
+		vkh::Pool<int, CountingBatchPolicy> pool{CountingBatchPolicy{&created, &destroyed, &failBatch}};
+		bool threw = false;
+		try {
+			pool.get();
+		} catch (const std::runtime_error &) {
+			threw = true;
+		}
+		CHECK(threw);
+
+		failBatch = false;
+		for (int i = 0; i < 10; ++i) {
+			CHECK(pool.get() != 0);
+		}
+		pool.flush();
+	}
+	CHECK(created > 0);
+	CHECK(destroyed == created);
+}
+
+struct CountingCreatePolicy {
+	int *created;
+	int *destroyed;
+	// create() throws once created reaches it
+	int *failAt;
+
+	int create() {
+		if (*created == *failAt) {
+			throw std::runtime_error("creation failed");
+		}
+		return ++*created;
+	}
+	void reset(int) {}
+	void destroy(int element) {
+		CHECK(element != 0);
+		++*destroyed;
+	}
+};
+
+// refilling a magazine must not leave default constructed elements behind when creation throws
+void testConcurrentPoolCreateThrows() {
+	{
+		int created = 0;
+		int destroyed = 0;
+		bool failBatch = true;
+		{
+			vkh::ConcurrentPool<int, CountingBatchPolicy> pool{CountingBatchPolicy{&created, &destroyed, &failBatch}, 2, 8};
+			bool threw = false;
+			try {
+				pool.get();
+			} catch (const std::runtime_error &) {
+				threw = true;
+			}
+			CHECK(threw);
+
+			failBatch = false;
+			for (int i = 0; i < 10; ++i) {
+				CHECK(pool.get() != 0);
+			}
+			pool.flush();
+		}
+		CHECK(created > 0);
+		CHECK(destroyed == created);
+	}
+	{
+		int created = 0;
+		int destroyed = 0;
+		// fails in the middle of the first refill
+		int failAt = 3;
+		{
+			vkh::ConcurrentPool<int, CountingCreatePolicy> pool{CountingCreatePolicy{&created, &destroyed, &failAt}, 2, 8};
+			bool threw = false;
+			try {
+				pool.get();
+			} catch (const std::runtime_error &) {
+				threw = true;
+			}
+			CHECK(threw);
+			// the elements created before the throw are destroyed right away
+			CHECK(destroyed == 3);
+
+			failAt = -1;
+			for (int i = 0; i < 10; ++i) {
+				CHECK(pool.get() != 0);
+			}
+			pool.flush();
+		}
+		CHECK(destroyed == created);
+	}
+}
+
+struct StressPoolState {
+	static constexpr std::int64_t freeState = -1;
+	static constexpr std::int64_t usedState = -2;
+	static constexpr int capacity = 1 << 16;
+
+	// freeState, usedState or the epoch the element was flushed in
+	std::unique_ptr<std::atomic<std::int64_t>[]> states{std::make_unique<std::atomic<std::int64_t>[]>(capacity)};
+	std::atomic<int> created{0};
+	// the epoch advanceEpoch() is about to publish, set before each call
+	std::int64_t recycleEpoch{0};
+	std::uint32_t framesInFlight{0};
+};
+
+struct StressPoolPolicy {
+	StressPoolState *state;
+
+	int create() {
+		const int el = state->created.fetch_add(1, std::memory_order_relaxed);
+		CHECK(el < StressPoolState::capacity);
+		state->states[el].store(StressPoolState::freeState, std::memory_order_relaxed);
+		return el;
+	}
+	void reset(int el) {
+		const std::int64_t flushEpoch = state->states[el].exchange(StressPoolState::freeState, std::memory_order_relaxed);
+		// only flushed elements get reset, and not before the gpu is done with their frame
+		CHECK(flushEpoch >= 0);
+		CHECK(state->recycleEpoch - flushEpoch >= state->framesInFlight);
+	}
+	void destroy(int) {}
+};
+
+// many threads get and flush every frame, no element may be handed out twice or recycled before framesInFlight epochs
+void testConcurrentPoolStress() {
+	constexpr std::uint32_t threadCount = 8;
+	constexpr std::uint32_t framesInFlight = 3;
+	constexpr int frameCount = 300;
+	StressPoolState state;
+	state.framesInFlight = framesInFlight;
+	vkh::ConcurrentPool<int, StressPoolPolicy> pool{StressPoolPolicy{&state}, framesInFlight, 16};
+
+	std::barrier frameStart{threadCount + 1};
+	std::barrier frameEnd{threadCount + 1};
+	std::vector<std::thread> threads;
+	for (std::uint32_t t = 0; t < threadCount; ++t) {
+		threads.emplace_back([&, t]() {
+			std::vector<int> held;
+			for (int frame = 0; frame < frameCount; ++frame) {
+				frameStart.arrive_and_wait();
+				const int count = 50 + static_cast<int>(t * frame % 100);
+				for (int i = 0; i < count; ++i) {
+					const int el = pool.get();
+					std::int64_t expected = StressPoolState::freeState;
+					CHECK(state.states[el].compare_exchange_strong(expected, StressPoolState::usedState, std::memory_order_relaxed));
+					held.push_back(el);
+				}
+				const auto epoch = static_cast<std::int64_t>(pool.getEpoch());
+				for (int el : held) {
+					state.states[el].store(epoch, std::memory_order_relaxed);
+				}
+				held.clear();
+				pool.flush();
+				frameEnd.arrive_and_wait();
+			}
+		});
+	}
+	for (int frame = 0; frame < frameCount; ++frame) {
+		frameStart.arrive_and_wait();
+		frameEnd.arrive_and_wait();
+		state.recycleEpoch = static_cast<std::int64_t>(pool.getEpoch()) + 1;
+		pool.advanceEpoch();
+	}
+	for (auto &thread : threads) {
+		thread.join();
+	}
+	// elements are recycled, so far fewer than the ~240000 gets had to be created
+	CHECK(state.created.load() < 20000);
+}
+
 int main() {
+	testPoolCreateBatchThrows();
+	testConcurrentPoolCreateThrows();
+	testConcurrentPoolStress();
+	testDescriptorSetCacheIgnoresUndefinedPayloadBytes();
+	if (auto testDevice = createTestDevice()) {
+		testDescriptorSetLayoutCacheConcurrency(*testDevice->device);
+		testDescriptorSetLayoutCacheImmutableSamplers(*testDevice->device);
+		testDescriptorSetBatchSpansPools(*testDevice);
+		testDescriptorSetBuilderArrayBindings(*testDevice);
+		testShaderModuleCacheSharing(*testDevice->device);
+		testPipelineCacheMap(*testDevice->device);
+		testFrameDescriptorAllocator(*testDevice->device);
+		testCommandBufferAllocator(*testDevice);
+		testThreadedCommandContextReusesThreadIndices(*testDevice);
+		testStaticCommandBufferCacheRecordThrows(*testDevice);
+	}
+	if (auto testDevice = createTestDevice(true)) {
+		testBindlessDescriptorHeapChecksUpdateAfterBind(*testDevice);
+	}
+	std::puts("all tests passed");
 }
@@ -0,0 +1,88 @@
+#define VULKANHELPER_IMPLEMENTATION
+#include <vulkanhelper.hpp>
+
+#include <filesystem>
+
+#include "test-device.hpp"
+#include "benchmark.hpp"
+
+struct CorpusShader {
+	std::string name;
+	std::vector<uint32_t> spv;
+	vk::ShaderStageFlagBits stage;
+};
+
+// loads every compiled shader of tests/shaders, the stage comes from the extension in front of .spv
+std::vector<CorpusShader> loadCorpus(const std::filesystem::path &directory) {
+	const std::pair<std::string_view, vk::ShaderStageFlagBits> stages[] = {
+		{".vert", vk::ShaderStageFlagBits::eVertex},
+		{".frag", vk::ShaderStageFlagBits::eFragment},
+		{".comp", vk::ShaderStageFlagBits::eCompute},
+	};
+
+	std::vector<CorpusShader> corpus;
+	for (const auto &entry : std::filesystem::directory_iterator(directory)) {
+		if (entry.path().extension() != ".spv") {
+			continue;
+		}
+		const std::string stageExtension = entry.path().stem().extension().string();
+		auto stage = std::find_if(std::begin(stages), std::end(stages), [&](const auto &pair) {
+			return pair.first == stageExtension;
+		});
+		CHECK(stage != std::end(stages));
+
+		std::ifstream file(entry.path(), std::ios::binary | std::ios::ate);
+		CHECK(file.is_open());
+		std::vector<uint32_t> spv(static_cast<std::size_t>(file.tellg()) / sizeof(uint32_t));
+		file.seekg(0);
+		file.read(reinterpret_cast<char *>(spv.data()), spv.size() * sizeof(uint32_t));
+		corpus.push_back({entry.path().filename().string(), std::move(spv), stage->second});
+	}
+	std::sort(corpus.begin(), corpus.end(), [](const auto &a, const auto &b) {
+		return a.name < b.name;
+	});
+	return corpus;
+}
+
+// the builtin scanner has to reflect exactly what spirv reflect reflects
+void testBuiltinReflectionMatchesSpirvReflect(const std::vector<CorpusShader> &corpus) {
+	for (const auto &shader : corpus) {
+		std::printf("checking %s\n", shader.name.c_str());
+		auto builtin = vkh::reflectShaderBuiltin(shader.spv, shader.stage);
+		auto reference = vkh::reflectShaderSpirvReflect(shader.spv, shader.stage);
+
+		CHECK(builtin.stage == reference.stage);
+		CHECK(builtin.setBindings == reference.setBindings);
+		CHECK(builtin.pushConstants == reference.pushConstants);
+		CHECK(builtin.vertexInputs.size() == reference.vertexInputs.size());
+		for (std::size_t i = 0; i < builtin.vertexInputs.size(); ++i) {
+			CHECK(builtin.vertexInputs[i].location == reference.vertexInputs[i].location);
+			CHECK(builtin.vertexInputs[i].format == reference.vertexInputs[i].format);
+			CHECK(builtin.vertexInputs[i].format != vk::Format::eUndefined);
+		}
+	}
+}
+
+// only reports the timings, a timing threshold would make the test flaky on loaded machines
+void measureReflectionTime(const std::vector<CorpusShader> &corpus) {
+	constexpr std::size_t iterations = 2000;
+	const double builtin = measureMicroseconds(iterations, [&]() {
+		for (const auto &shader : corpus) {
+			vkh::reflectShaderBuiltin(shader.spv, shader.stage);
+		}
+	});
+	const double reference = measureMicroseconds(iterations, [&]() {
+		for (const auto &shader : corpus) {
+			vkh::reflectShaderSpirvReflect(shader.spv, shader.stage);
+		}
+	});
+	std::printf("reflecting %zu shaders: builtin %.2f us, spirv reflect %.2f us, %.1fx\n", corpus.size(), builtin, reference, reference / builtin);
+}
+
+int main() {
+	auto corpus = loadCorpus(VULKANHELPER_TEST_SHADER_DIRECTORY);
+	CHECK(!corpus.empty());
+	testBuiltinReflectionMatchesSpirvReflect(corpus);
+	measureReflectionTime(corpus);
+	std::puts("all tests passed");
+}
@@ -0,0 +1,17 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(location = 0) in vec2 inUv;
+layout(location = 2) flat in uint inMaterial;
+layout(location = 0) out vec4 outColor;
+
+layout(set = 0, binding = 0) uniform sampler samplers[];
+layout(set = 0, binding = 1) uniform texture2D textures[];
+layout(set = 0, binding = 3) readonly buffer Materials {
+	uvec2 textureAndSampler[];
+} materials[];
+
+void main() {
+	uvec2 indices = materials[0].textureAndSampler[inMaterial];
+	outColor = texture(sampler2D(textures[nonuniformEXT(indices.x)], samplers[nonuniformEXT(indices.y)]), inUv);
+}
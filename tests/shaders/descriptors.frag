@@ -0,0 +1,30 @@
+#version 450
+
+layout(location = 0) in vec2 inUv;
+layout(location = 1) in vec4 inColor;
+layout(location = 0) out vec4 outColor;
+
+layout(set = 0, binding = 1) uniform sampler2D albedo;
+layout(set = 0, binding = 2) uniform sampler2D shadowCascades[4];
+layout(set = 1, binding = 0) uniform texture2D detail;
+layout(set = 1, binding = 1) uniform sampler detailSampler;
+layout(set = 1, binding = 2, rgba8) uniform readonly image2D mask;
+layout(set = 1, binding = 3) uniform samplerBuffer lookup;
+layout(set = 1, binding = 4, r32ui) uniform uimageBuffer counters;
+layout(set = 2, binding = 0) uniform Material {
+	vec4 tint;
+	float roughness;
+} material;
+
+layout(push_constant) uniform Constants {
+	layout(offset = 80) vec4 fog;
+	float exposure;
+} constants;
+
+void main() {
+	vec4 color = texture(albedo, inUv) * texture(sampler2D(detail, detailSampler), inUv);
+	color *= texture(shadowCascades[2], inUv).r + imageLoad(mask, ivec2(inUv * 64)).r;
+	color += texelFetch(lookup, int(inUv.x * 16));
+	imageAtomicAdd(counters, 0, 1u);
+	outColor = mix(color * material.tint * inColor, constants.fog, material.roughness) * constants.exposure;
+}
@@ -0,0 +1,9 @@
+#version 450
+
+layout(input_attachment_index = 0, set = 0, binding = 0) uniform subpassInput lighting;
+layout(input_attachment_index = 1, set = 0, binding = 1) uniform subpassInput emissive;
+layout(location = 0) out vec4 outColor;
+
+void main() {
+	outColor = subpassLoad(lighting) + subpassLoad(emissive);
+}
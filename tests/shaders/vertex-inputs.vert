@@ -0,0 +1,33 @@
+#version 450
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec2 inUv;
+layout(location = 2) in ivec4 inBoneIndices;
+layout(location = 3) in uint inMaterial;
+layout(location = 5) in vec4 inColor;
+
+layout(location = 0) out vec2 outUv;
+layout(location = 1) out vec4 outColor;
+layout(location = 2) flat out uint outMaterial;
+
+layout(set = 0, binding = 0) uniform Camera {
+	mat4 viewProjection;
+	vec4 position;
+} camera;
+
+layout(set = 1, binding = 0) readonly buffer Bones {
+	mat4 bones[];
+};
+
+layout(push_constant) uniform Constants {
+	mat4 model;
+	uint boneOffset;
+} constants;
+
+void main() {
+	mat4 skin = bones[constants.boneOffset + inBoneIndices.x] + bones[constants.boneOffset + inBoneIndices.y];
+	gl_Position = camera.viewProjection * constants.model * skin * vec4(inPosition, 1);
+	outUv = inUv;
+	outColor = inColor;
+	outMaterial = inMaterial;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+
+// unlike assert, checks stay active in release builds
+inline void checkCondition(bool condition, const char *expression, const char *file, int line) {
+	if (!condition) {
+		std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+		std::exit(EXIT_FAILURE);
+	}
+}
+#define CHECK(condition) checkCondition(static_cast<bool>(condition), #condition, __FILE__, __LINE__)
+
+struct TestDevice {
+	vk::UniqueInstance instance;
+	vk::PhysicalDevice physicalDevice;
+	vk::UniqueDevice device;
+	uint32_t queueFamilyIndex{0};
+};
+
+// Returns nullopt when there is no usable vulkan device, so device tests get skipped on machines without one.
+inline std::optional<TestDevice> createTestDevice(bool enableDescriptorIndexing = false) {
+	try {
+		TestDevice testDevice;
+		testDevice.instance = vk::UniqueInstance{vkh::createInstance({}, {})};
+		testDevice.physicalDevice = vkh::selectPhysicalDevice(*testDevice.instance, [](vk::PhysicalDevice physicalDevice) -> std::size_t {
+			return physicalDevice.getProperties().deviceType == vk::PhysicalDeviceType::eDiscreteGpu ? 2 : 1;
+		});
+
+		const auto queueFamilies = testDevice.physicalDevice.getQueueFamilyProperties();
+		const vk::QueueFlags requiredFlags = vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute;
+		bool foundQueueFamily = false;
+		for (uint32_t i = 0; i < queueFamilies.size() && !foundQueueFamily; ++i) {
+			if ((queueFamilies[i].queueFlags & requiredFlags) == requiredFlags) {
+				testDevice.queueFamilyIndex = i;
+				foundQueueFamily = true;
+			}
+		}
+		if (!foundQueueFamily) {
+			throw std::runtime_error("no queue family supports graphics and compute");
+		}
+
+		testDevice.device = vk::UniqueDevice{vkh::createLogicalDevice(testDevice.physicalDevice, {testDevice.queueFamilyIndex}, {}, enableDescriptorIndexing)};
+		return testDevice;
+	} catch (const std::exception &e) {
+		std::fprintf(stderr, "skipping device tests: %s\n", e.what());
+		return std::nullopt;
+	}
+}